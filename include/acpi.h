@@ -0,0 +1,104 @@
+#ifndef __ACPI_H__
+#define __ACPI_H__
+
+#include <stdint.h>
+
+#define ACPI_MADT_SIGNATURE "APIC"
+#define ACPI_HPET_SIGNATURE "HPET"
+
+#define MADT_LAPIC 0
+#define MADT_IOAPIC 1
+#define MADT_INTERRUPT_OVERRIDE 2
+#define MADT_LAPIC_ADDRESS_OVERRIDE 5
+
+#define MADT_POLARITY_MASK 0x3
+#define MADT_POLARITY_ACTIVE_LOW 0x3
+#define MADT_TRIGGER_MASK 0xC
+#define MADT_TRIGGER_LEVEL 0xC
+
+typedef struct
+{
+    char signature[8];
+    uint8_t checksum; // of the first 20 bytes, the ACPI 1.0 part
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    // revision 2 and later
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct
+{
+    char signature[4];
+    uint32_t length; // of the whole table
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct
+{
+    acpi_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[]; // madt_entry_t of variable lengths up to header.length
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base; // first global system interrupt of its inputs
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t bus; // always 0, ISA
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags; // MADT_POLARITY_* and MADT_TRIGGER_*, 0 keeps the bus default
+} __attribute__((packed)) madt_interrupt_override_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed)) madt_lapic_address_override_t;
+
+typedef struct
+{
+    acpi_header_t header;
+    uint32_t event_timer_block_id;
+    uint8_t address_space_id; // 0, memory
+    uint8_t register_bit_width;
+    uint8_t register_bit_offset;
+    uint8_t reserved;
+    uint64_t address;
+    uint8_t hpet_number;
+    uint16_t minimum_tick;
+    uint8_t page_protection;
+} __attribute__((packed)) acpi_hpet_t;
+
+void *acpi_find_table(const char *signature);
+
+#endif // __ACPI_H__
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef __APIC_H__
+#define __APIC_H__
+
+#include <stdint.h>
+
+#define APIC_SPURIOUS_VECTOR 0xFF // its low 4 bits must be set on P6 processors
+#define MAX_IOAPICS 4
+#define NB_ISA_IRQS 16
+
+extern volatile uint32_t *lapic_eoi; // end of interrupt register written by irq_common, NULL with the 8259
+
+void init_apic(void);
+uint32_t lapic_id(void);
+uint32_t lapic_timer_init(uint8_t vector);
+void lapic_timer_arm(uint64_t ns);
+
+#endif // __APIC_H__
\ No newline at end of file
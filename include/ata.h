@@ -0,0 +1,13 @@
+#ifndef __ATA_H__
+#define __ATA_H__
+
+#include <stdint.h>
+
+#define ATA_SECTOR_SIZE 512
+
+int ata_init(void);
+uint32_t ata_sectors(void);
+int ata_read(uint32_t lba, uint8_t nb_sectors, void *buf);
+int ata_write(uint32_t lba, uint8_t nb_sectors, const void *buf);
+
+#endif // __ATA_H__
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+
+void bench_address_space_switch(uint32_t iterations);
+void bench_mem(void);
+void bench_interrupts(void);
+
+#endif // __BENCH_H__
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef __BUDDY_H__
+#define __BUDDY_H__
+
+#include <stdint.h>
+
+#define MAX_ORDER 10 // biggest block is 2^10 pages (4 MiB)
+#define NO_FRAME 0xFFFFFFFF
+#define ZERO_POOL_SIZE 64 // zeroed pages kept ready per zone
+
+#define FRAME_FREE 0x1 // head of a block sitting in a free list
+#define FRAME_SLAB 0x2 // page owned by a slab cache
+#define FRAME_ANON 0x4 // anonymous user page, its mappings are in rmap
+#define FRAME_ZERO 0x8 // anonymous page zero filled on demand, unchanged unless a mapping is dirty
+
+typedef enum
+{
+    ZONE_NORMAL = 0,  // direct mapped at KERNEL_VIRT_BASE
+    ZONE_HIGHMEM = 1, // above lowmem_end, only reachable through page tables
+    NB_ZONES
+} zone_type_t;
+
+typedef struct
+{
+    union
+    {
+        struct
+        {
+            uint32_t next; // free list links, as page frame numbers
+            uint32_t prev;
+        };
+        void *slab; // slab the page belongs to when FRAME_SLAB is set
+        void *rmap; // page table entries mapping the page when FRAME_ANON is set
+    };
+    uint16_t refcount;
+    uint8_t order; // order of the block this frame is the head of
+    uint8_t flags;
+} frame_t;
+
+extern frame_t *mem_map;
+extern uint32_t max_pfn;
+
+void init_buddy(void);
+uint32_t alloc_pages_zone(zone_type_t zone, uint8_t order);
+uint32_t alloc_pages(uint8_t order);
+void free_pages(uint32_t addr, uint8_t order);
+uint32_t alloc_page(void);
+uint32_t alloc_highmem_page(void);
+void free_page(uint32_t addr);
+uint32_t alloc_zeroed_page(void);
+uint32_t alloc_zeroed_highmem_page(void);
+void zero_pool_refill(void);
+void get_page(uint32_t addr);
+void put_page(uint32_t addr);
+frame_t *addr_to_frame(uint32_t addr);
+void buddy_stats(void);
+
+#endif // __BUDDY_H__
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <stdint.h>
+
+#define HZ 100 // PIT interrupts per second
+#define NSEC_PER_SEC 1000000000
+#define NSEC_PER_MSEC 1000000
+#define NSEC_PER_TICK (NSEC_PER_SEC / HZ)
+
+#define PIT_FREQUENCY 1193182
+#define PIT_IRQ 0
+#define PIT_CHANNEL0 0x40
+#define PIT_COMMAND 0x43
+#define PIT_CHANNEL0_ONE_SHOT 0x30 // low then high byte, mode 0
+
+#define CLOCK_MONOTONIC 1 // time since boot, the only clock without a real time source
+
+typedef struct
+{
+    uint32_t tv_sec;
+    uint32_t tv_nsec;
+} timespec_t;
+
+extern volatile uint32_t jiffies; // HZ ticks since init_clock, they stop once init_timer goes one-shot
+extern uint32_t tsc_khz;          // 0 without a TSC
+
+void init_clock(void);
+uint64_t ktime_get(void);
+
+#endif // __CLOCK_H__
\ No newline at end of file
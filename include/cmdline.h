@@ -0,0 +1,8 @@
+#ifndef __CMDLINE_H__
+#define __CMDLINE_H__
+
+#include <stddef.h>
+
+int cmdline_get(const char *key, char *value, size_t size);
+
+#endif // __CMDLINE_H__
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CONSOLE_SCREEN 1 // VGA text or the framebuffer console
+#define CONSOLE_SERIAL 2
+#define CONSOLE_ALL (CONSOLE_SCREEN | CONSOLE_SERIAL)
+
+void console_set_outputs(uint8_t outputs);
+void console_write(const char *buffer, size_t len);
+void console_write_to(uint8_t outputs, const char *buffer, size_t len);
+void console_printf(uint8_t outputs, const char *fmt, ...);
+void console_sync(void);
+
+#endif // __CONSOLE_H__
\ No newline at end of file
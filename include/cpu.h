@@ -0,0 +1,115 @@
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include <stdint.h>
+
+#define CR0_MP 0x2 // wait and fwait honour CR0.TS
+#define CR0_EM 0x4 // x87 emulation, makes every SSE instruction fault
+
+#define CR4_PSE 0x10         // 4 MiB pages
+#define CR4_PGE 0x80         // global pages survive CR3 reloads
+#define CR4_OSFXSR 0x200     // SSE instructions are enabled
+#define CR4_OSXMMEXCPT 0x400 // SIMD floating point exceptions are reported as #XM
+
+#define CPUID_FEATURES 1
+#define CPUID_EDX_PSE (1 << 3)
+#define CPUID_EDX_TSC (1 << 4)
+#define CPUID_EDX_APIC (1 << 9) // local APIC
+#define CPUID_EDX_SEP (1 << 11) // sysenter and sysexit
+#define CPUID_EDX_PGE (1 << 13)
+#define CPUID_EDX_PAT (1 << 16)
+#define CPUID_EDX_SSE2 (1 << 26)
+#define CPUID_EXTENDED_FEATURES 7
+#define CPUID_EBX_ERMS (1 << 9) // enhanced rep movsb/stosb
+#define CPUID_EXTENDED_MAX 0x80000000 // highest extended leaf
+#define CPUID_POWER_MANAGEMENT 0x80000007
+#define CPUID_EDX_INVARIANT_TSC (1 << 8) // constant rate in every P, C and T state
+
+#define MSR_APIC_BASE 0x1B
+#define MSR_APIC_BASE_ENABLE (1 << 11)
+#define MSR_SYSENTER_CS 0x174 // kernel code selector, the stack selector is the next one
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+#define MSR_PAT 0x277
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    __asm__ volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline uint32_t read_cr0(void)
+{
+    uint32_t cr0;
+    __asm__ volatile("movl %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0)
+{
+    __asm__ volatile("movl %0, %%cr0" ::"r"(cr0) : "memory");
+}
+
+static inline uint32_t read_cr4(void)
+{
+    uint32_t cr4;
+    __asm__ volatile("movl %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void write_cr4(uint32_t cr4)
+{
+    __asm__ volatile("movl %0, %%cr4" ::"r"(cr4) : "memory");
+}
+
+static inline uint32_t read_cr3(void)
+{
+    uint32_t cr3;
+    __asm__ volatile("movl %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+static inline void write_cr3(uint32_t cr3)
+{
+    __asm__ volatile("movl %0, %%cr3" ::"r"(cr3) : "memory");
+}
+
+static inline void invlpg(uint32_t addr)
+{
+    __asm__ volatile("invlpg (%0)" ::"r"(addr) : "memory");
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t low, high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t low, high;
+    __asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    __asm__ volatile("wrmsr" ::"c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+/**
+ * @brief Disables interrupts and returns the previous EFLAGS to give to irq_restore.
+ */
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+    __asm__ volatile("pushfl\n popl %0\n cli" : "=r"(flags)::"memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    __asm__ volatile("pushl %0\n popfl" ::"r"(flags) : "memory", "cc");
+}
+
+#endif // __CPU_H__
\ No newline at end of file
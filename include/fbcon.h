@@ -0,0 +1,13 @@
+#ifndef __FBCON_H__
+#define __FBCON_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FBCON_MAX_ROWS 128 // text rows, 2048 pixels high
+
+int init_fbcon(void);
+uint8_t fbcon_active(void);
+void fbcon_write(const char *buffer, size_t len);
+
+#endif // __FBCON_H__
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef __FONT_H__
+#define __FONT_H__
+
+#include <stdint.h>
+
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 16
+#define FONT_GLYPHS 128
+
+extern const uint8_t font_glyphs[FONT_GLYPHS][FONT_HEIGHT];
+
+#endif // __FONT_H__
\ No newline at end of file
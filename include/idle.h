@@ -0,0 +1,28 @@
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Something to wait for: interrupt handlers call wake_up when it happens. There are no tasks,
+ * so a waiter is the CPU itself, idling until the count of events moves.
+ */
+typedef struct
+{
+    volatile uint32_t events;
+} wait_queue_t;
+
+static inline uint32_t wait_queue_events(wait_queue_t *queue)
+{
+    return __atomic_load_n(&queue->events, __ATOMIC_ACQUIRE);
+}
+
+static inline void wake_up(wait_queue_t *queue)
+{
+    __atomic_add_fetch(&queue->events, 1, __ATOMIC_RELEASE);
+}
+
+void idle_once(void);
+void wait_event(wait_queue_t *queue, uint32_t seen);
+
+#endif // __IDLE_H__
\ No newline at end of file
@@ -3,6 +3,12 @@
 
 #include <stdint.h>
 
+#define NB_FAULTS 32
+#define IRQ_BASE 0x20 // the master PIC, the slave comes right after
+#define IRQ_SLAVE_BASE 0x28
+#define NB_IRQS 16
+#define FIRST_INT_VECTOR 0x30
+
 struct regs
 {
     unsigned int gs, fs, es, ds;                         /* pushed the segs last */
@@ -12,6 +18,8 @@ struct regs
 };
 
 void init_idt(void);
+void mask_pic(void);
+void set_idt_gate(uint8_t vector, void (*stub)(void), uint8_t dpl);
 void set_irq_handler(uint8_t irq_no, void *handler);
 void set_int_handler(uint8_t int_no, void *handler, uint8_t dpl);
 void set_fault_handler(uint8_t fault_no, void *handler);
@@ -15,4 +15,16 @@ static inline void outb(unsigned short port UNUSED, unsigned char value UNUSED)
     __asm__ volatile("outb %0, %1" ::"a"(value), "Nd"(port));
 }
 
+static inline unsigned short inw(unsigned short port UNUSED)
+{
+    unsigned short ret;
+    __asm__ volatile("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(unsigned short port UNUSED, unsigned short value UNUSED)
+{
+    __asm__ volatile("outw %0, %1" ::"a"(value), "Nd"(port));
+}
+
 #endif // __IOPORT_H__
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef __IRQSTATS_H__
+#define __IRQSTATS_H__
+
+#include <stdint.h>
+
+#define IRQ_STATS_BUCKETS 32 // bucket i counts the durations in [2^i, 2^(i+1)) cycles, bucket 0 also has 0
+
+typedef enum
+{
+    IRQ_STAT_ENTRY,   // stub entry to handler entry
+    IRQ_STAT_HANDLER, // handler run time
+    IRQ_STAT_EXIT,    // end of interrupt to iret, with the softirqs run on the way
+    NB_IRQ_STATS
+} irq_stat_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max[NB_IRQ_STATS];
+    uint32_t buckets[NB_IRQ_STATS][IRQ_STATS_BUCKETS];
+} irq_stats_t;
+
+void irq_stats_record(uint32_t vector, uint32_t entry, uint32_t handler, uint32_t exit);
+int irq_stats_get(uint32_t vector, irq_stats_t *stats);
+void irq_stats_reset(void);
+void irq_stats_dump(void);
+
+#endif // __IRQSTATS_H__
\ No newline at end of file
@@ -1,9 +1,27 @@
 #ifndef __KEYBOARD_H__
 #define __KEYBOARD_H__
 
-void init_key_map();
-void keyboard_handler();
-// unsigned char getc();
-// void gets(char *buf, int nb_char);
+#include <stdint.h>
+#include <stddef.h>
+
+#define KEY_MOD_SHIFT 0x1
+#define KEY_MOD_CTRL 0x2
+#define KEY_MOD_ALT 0x4
+#define KEY_MOD_ALTGR 0x8
+#define KEY_MOD_CAPS_LOCK 0x10
+
+typedef struct
+{
+    uint8_t code;      // scancode of set 1, with KEY_EXTENDED for the E0 keys
+    uint8_t modifiers; // KEY_MOD_* after the event
+    uint8_t pressed;
+    char c; // character typed by a press with the keymap, 0 when none
+} key_event_t;
+
+void init_keyboard(void);
+void keyboard_handler(void);
+uint8_t keyboard_poll_event(key_event_t *event);
+int keyboard_getc(void);
+size_t keyboard_read(char *buffer, size_t size);
 
 #endif // __KEYBOARD_H__
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __KEYMAP_H__
+#define __KEYMAP_H__
+
+#include <stdint.h>
+
+#define KEY_EXTENDED 0x80 // added to the scancode of the keys sent after an E0 prefix
+#define KEY_RELEASED 0x80 // set in a scancode when the key is released
+#define NB_KEY_CODES 256
+
+/**
+ * @brief Characters given by each key code, 0 for the keys that type nothing.
+ */
+typedef struct
+{
+    const char *name;
+    char normal[NB_KEY_CODES];
+    char shifted[NB_KEY_CODES];
+    char altgr[NB_KEY_CODES];
+} keymap_t;
+
+extern const keymap_t keymaps[];
+extern const uint32_t nb_keymaps;
+
+#endif // __KEYMAP_H__
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef __KLOG_H__
+#define __KLOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define KLOG_RECORDS 128 // the oldest records are overwritten once the ring is full
+#define KLOG_TEXT 112    // longer messages are truncated
+
+typedef enum
+{
+    KLOG_ERR,
+    KLOG_WARN,
+    KLOG_INFO,
+    KLOG_DEBUG,
+    NB_KLOG_LEVELS
+} klog_level_t;
+
+/**
+ * @brief A message of the ring. seq is 0 while a producer fills it, then the sequence number of the message + 1.
+ */
+typedef struct
+{
+    volatile uint32_t seq;
+    uint8_t level;
+    uint8_t len;
+    uint64_t timestamp; // TSC when the message was logged
+    char text[KLOG_TEXT];
+} klog_record_t;
+
+void klog(klog_level_t level, const char *fmt, ...);
+size_t klog_read(uint32_t *seq, char *buffer, size_t size, klog_level_t max_level);
+void klog_flush(void);
+void klog_set_console_level(klog_level_t level);
+void klog_set_console_outputs(uint8_t outputs);
+
+#endif // __KLOG_H__
\ No newline at end of file
@@ -2,12 +2,21 @@
 #define __LIB_H__
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
 #include "screen.h"
 
 void putc(char c);
 void puts(const char *data);
 size_t strlen(const char *str);
+int strcmp(const char *s1, const char *s2);
 void *memset(void *ptr, int value, size_t size);
+void *memcpy(void *dest, const void *src, size_t size);
+void *memmove(void *dest, const void *src, size_t size);
+int memcmp(const void *ptr1, const void *ptr2, size_t size);
+uint32_t div64(uint64_t *n, uint32_t base);
+int vsnprintf(char *buffer, size_t size, const char *fmt, va_list args);
+int snprintf(char *buffer, size_t size, const char *fmt, ...);
 void printf(const char *fmt, ...);
 
 #endif // __LIB_H__
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Ways to fill or copy memory, memset and memcpy pick one for each size from the CPU features.
+ */
+typedef enum
+{
+    MEM_IMPL_LOOP,          // byte loop, the reference
+    MEM_IMPL_REP_BYTE,      // rep stosb/movsb, fast on CPUs with ERMS
+    MEM_IMPL_REP_DWORD,     // rep stosl/movsl
+    MEM_IMPL_SSE2,          // 16 bytes stores to an aligned destination
+    MEM_IMPL_NON_TEMPORAL,  // movnti stores that bypass the cache
+    NB_MEM_IMPLS
+} mem_impl_t;
+
+void init_mem(void);
+uint8_t mem_impl_supported(mem_impl_t impl);
+const char *mem_impl_name(mem_impl_t impl);
+void *memset_impl(mem_impl_t impl, void *ptr, int value, size_t size);
+void *memcpy_impl(mem_impl_t impl, void *dest, const void *src, size_t size);
+
+#endif // __MEM_H__
\ No newline at end of file
@@ -5,24 +5,109 @@
 #include "idt.h"
 #include "lib.h"
 
+#define PAGE_SIZE 4096
+#define LARGE_PAGE_SIZE 0x400000
+#define CR0_PG 0x80000000
+#define CR0_WP 0x10000 // read only pages are also read only for the kernel
+
+#define KERNEL_VIRT_BASE 0xC0000000 // kernel_virt_address in link.ld
+#define DIRECT_MAP_SIZE 0x38000000  // physical memory reachable at KERNEL_VIRT_BASE (896 MiB)
+#define USER_SPACE_START 0x40000000 // user_address in link.ld, user mappings live in [USER_SPACE_START, KERNEL_VIRT_BASE)
+#define VMALLOC_START (KERNEL_VIRT_BASE + DIRECT_MAP_SIZE) // kernel window for vmm_map, its page tables exist from boot
+#define KMAP_BASE 0xFF800000                              // temporary kernel mappings of pages outside the direct map
+#define PAGE_TABLES_BASE 0xFFC00000                       // the page directory maps itself in its last entry
+#define KMAP_SLOTS 8
+#define MAX_MEMORY_REGIONS 32
+
+#define MAP_WRITE 0x1
+#define MAP_USER 0x2
+#define MAP_GLOBAL 0x4 // kept in the TLB across address space switches, kernel mappings only
+#define MAP_ANON 0x8   // user page refcounted by the VM, put with its last mapping
+
+#define PAGE_TO_ADDR(page) ((void *)((uintptr_t)page << 12))
+#define ADDR_TO_PAGE(addr) ((uint32_t)((uintptr_t)addr >> 12))
+#define PAGE_ALIGN_UP(addr) (((addr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_DOWN(addr) ((addr) & ~(PAGE_SIZE - 1))
+
 #define MMU_ENABLE() ({                             \
     uint32_t cr0;                                   \
     __asm__ volatile("movl %%cr0, %0" : "=r"(cr0)); \
-    cr0 |= CR0_PG;                                  \
+    cr0 |= CR0_PG | CR0_WP;                         \
     __asm__ volatile("movl %0, %%cr0" ::"r"(cr0));  \
 })
 
 #define MMU_DISABLE() ({                            \
     uint32_t cr0;                                   \
     __asm__ volatile("movl %%cr0, %0" : "=r"(cr0)); \
-    cr0 &= ~CR0_PG;                                 \
+    cr0 &= ~(CR0_PG | CR0_WP);                      \
     __asm__ volatile("movl %0, %%cr0" ::"r"(cr0));  \
 })
 
-void init_mmu(void);
+typedef enum
+{
+    MEM_WB = 0,       // write-back, normal RAM
+    MEM_WC = 1,       // write-combining, framebuffers
+    MEM_UC_MINUS = 2, // uncached, MTRRs may still make it write-combining
+    MEM_UC = 3,       // uncached, MMIO
+    MEM_WT = 4,       // write-through
+} mem_type_t;
+
+typedef struct
+{
+    uint32_t start;
+    uint32_t end;
+} memory_region_t;
+
+extern memory_region_t memory_regions[MAX_MEMORY_REGIONS]; // free RAM at boot, page aligned
+extern uint32_t nb_memory_regions;
+extern uint32_t lowmem_end;        // end of the direct mapped physical memory
+extern uint32_t direct_map_offset; // 0 before paging, KERNEL_VIRT_BASE after
+extern uint32_t kernel_directory;  // physical address of the page directory built by init_mmu
+
+/**
+ * @brief Gets an address to reach a physical address below lowmem_end, with or without paging.
+ */
+static inline void *phys_to_virt(uint32_t phys_addr)
+{
+    return (void *)(phys_addr + direct_map_offset);
+}
+
+/**
+ * @brief Gets the physical address of a direct mapped address.
+ */
+static inline uint32_t virt_to_phys(void *virt_addr)
+{
+    return (uint32_t)virt_addr - KERNEL_VIRT_BASE;
+}
+
 void init_mmu(void);
 void enable_mmu(void);
 void disable_mmu(void);
+void map_range(uint32_t virt_addr, uint32_t phys_addr, uint32_t size, uint32_t flags, mem_type_t type);
+void mmu_dump(void);
+uint32_t create_address_space(void);
+void destroy_address_space(uint32_t directory);
+void switch_address_space(uint32_t directory);
+void flush_tlb_all(void);
+int map_user_page(uint32_t directory, uint32_t virt_addr, uint32_t phys_addr, uint32_t flags);
+uint32_t get_user_page(uint32_t directory, uint32_t virt_addr, uint32_t *flags);
+uint32_t get_user_swap_slot(uint32_t directory, uint32_t virt_addr);
+uint32_t unmap_user_page(uint32_t directory, uint32_t virt_addr, uint32_t *flags);
+void share_user_page_tables(uint32_t directory, uint32_t child);
+int unshare_user_page_table(uint32_t directory, uint32_t virt_addr);
+void put_user_page_tables(uint32_t directory);
+uint8_t page_referenced(uint32_t page);
+uint8_t page_dirty(uint32_t page);
+void try_to_unmap(uint32_t page, uint32_t slot);
+int vmm_map(uint32_t virt_addr, uint32_t phys_addr, uint32_t nb_pages, uint32_t flags, mem_type_t type);
+void vmm_unmap(uint32_t virt_addr, uint32_t nb_pages);
+void tlb_stats(void);
+void *ioremap(uint32_t phys_addr, uint32_t size, mem_type_t type);
+void *kmap(uint32_t phys_addr);
+void kunmap(void *virt_addr);
+void set_global_pages(uint8_t enabled);
+uint32_t boot_alloc_pages(uint32_t nb_pages);
+void boot_alloc_range(uint32_t *start, uint32_t *end);
 void page_fault_handler(struct regs *r);
 
 #endif // __MMU_H__
\ No newline at end of file
@@ -0,0 +1,8 @@
+#ifndef __MONITOR_H__
+#define __MONITOR_H__
+
+#define MONITOR_LINE 32
+
+void monitor_poll(void);
+
+#endif // __MONITOR_H__
\ No newline at end of file
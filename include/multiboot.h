@@ -0,0 +1,100 @@
+#ifndef __MULTIBOOT_H__
+#define __MULTIBOOT_H__
+
+#include <stdint.h>
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x36D76289
+
+#define MULTIBOOT_TAG_TYPE_END 0
+#define MULTIBOOT_TAG_TYPE_CMDLINE 1
+#define MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME 2
+#define MULTIBOOT_TAG_TYPE_MODULE 3
+#define MULTIBOOT_TAG_TYPE_BASIC_MEMINFO 4
+#define MULTIBOOT_TAG_TYPE_MMAP 6
+#define MULTIBOOT_TAG_TYPE_FRAMEBUFFER 8
+#define MULTIBOOT_TAG_TYPE_ACPI_OLD 14 // copy of the ACPI 1.0 RSDP
+#define MULTIBOOT_TAG_TYPE_ACPI_NEW 15 // copy of the ACPI 2.0 RSDP
+
+#define MULTIBOOT_FRAMEBUFFER_TYPE_INDEXED 0
+#define MULTIBOOT_FRAMEBUFFER_TYPE_RGB 1
+#define MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT 2
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+#define MULTIBOOT_MEMORY_RESERVED 2
+#define MULTIBOOT_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT_MEMORY_NVS 4
+#define MULTIBOOT_MEMORY_BADRAM 5
+
+typedef struct
+{
+    uint32_t total_size;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_info_t;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed)) multiboot_tag_t;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size;
+    char string[];
+} __attribute__((packed)) multiboot_tag_string_t;
+
+typedef struct
+{
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+    uint32_t zero;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    multiboot_mmap_entry_t entries[];
+} __attribute__((packed)) multiboot_tag_mmap_t;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size;
+    uint64_t addr;
+    uint32_t pitch; // bytes per line
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t framebuffer_type;
+    uint16_t reserved;
+    // MULTIBOOT_FRAMEBUFFER_TYPE_RGB
+    uint8_t red_position;
+    uint8_t red_size;
+    uint8_t green_position;
+    uint8_t green_size;
+    uint8_t blue_position;
+    uint8_t blue_size;
+} __attribute__((packed)) multiboot_tag_framebuffer_t;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size;
+    uint8_t rsdp[];
+} __attribute__((packed)) multiboot_tag_acpi_t;
+
+/**
+ * @brief Gets the tag following the given one, tags are padded to 8 bytes.
+ */
+#define MULTIBOOT_TAG_NEXT(tag) ((multiboot_tag_t *)((uint8_t *)(tag) + (((tag)->size + 7) & ~7)))
+
+extern multiboot_info_t *multiboot_info;
+
+multiboot_tag_t *multiboot_find_tag(uint32_t type);
+
+#endif // __MULTIBOOT_H__
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef __RECLAIM_H__
+#define __RECLAIM_H__
+
+#include <stdint.h>
+
+#define RECLAIM_BATCH 32 // pages freed when an allocation for a user page fails
+#define RECLAIM_SCAN_MAX 4096 // frames the clock hand passes per call, with the interrupts disabled
+
+uint32_t reclaim_pages(uint32_t nb_pages);
+void reclaim_stats(void);
+
+#endif // __RECLAIM_H__
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef __RMAP_H__
+#define __RMAP_H__
+
+#include <stdint.h>
+
+// one page table entry mapping an anonymous page, page tables being shared by clones until they write
+typedef struct rmap
+{
+    uint32_t table; // physical address of the page table
+    uint32_t index;
+    struct rmap *next;
+} rmap_t;
+
+void init_rmap(void);
+int rmap_add(uint32_t page, uint32_t table, uint32_t index);
+void rmap_remove(uint32_t page, uint32_t table, uint32_t index);
+rmap_t *rmap_first(uint32_t page);
+
+#endif // __RMAP_H__
\ No newline at end of file
@@ -8,6 +8,8 @@
 #define SCREEN_WIDTH 80
 #define SCREEN_HEIGHT 25
 #define SCREEN_BASE 0xB8000
+#define SCREEN_MEMORY_SIZE 0x8000 // text memory, the screen scrolls over all of it
+#define SCROLLBACK_LINES 256
 #define SCREEN ((uint16_t *)SCREEN_BASE)
 
 #define CURSOR_SIZE 1
@@ -15,6 +17,8 @@
 #define CURSOR_END (CURSOR_START + CURSOR_SIZE)
 
 void putchar(char c);
+void screen_write(const char *buffer, size_t len);
+void screen_scroll(int lines);
 void init_screen(void);
 void clear_screen(void);
 
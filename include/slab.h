@@ -0,0 +1,48 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KMALLOC_MIN_SHIFT 3  // 8 bytes
+#define KMALLOC_MAX_SHIFT 11 // 2048 bytes, bigger requests get whole pages
+#define KMALLOC_NB_CACHES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+typedef struct slab
+{
+    struct kmem_cache *cache;
+    struct slab *next;
+    struct slab *prev;
+    void *free_objects; // free objects of this slab, chained through their first word
+    uint32_t in_use;
+} slab_t;
+
+typedef struct kmem_cache
+{
+    const char *name;
+    uint32_t object_size;
+    uint32_t objects_offset; // where the first object starts in a slab
+    uint32_t objects_per_slab;
+    uint8_t order; // a slab is 2^order pages
+    slab_t *partial;
+    slab_t *full;
+    slab_t *empty;
+    uint32_t nb_slabs;
+    uint32_t nb_empty;
+    uint32_t active_objects;
+    uint32_t nb_allocs;
+    uint32_t nb_frees;
+    uint32_t nb_failures;
+    struct kmem_cache *next; // every cache, for the statistics
+} kmem_cache_t;
+
+void init_slab(void);
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *object);
+void kmem_cache_shrink(kmem_cache_t *cache);
+void *kmalloc(size_t size);
+void kfree(void *ptr);
+void kmem_cache_stats(void);
+
+#endif // __SLAB_H__
\ No newline at end of file
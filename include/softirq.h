@@ -0,0 +1,43 @@
+#ifndef __SOFTIRQ_H__
+#define __SOFTIRQ_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MAX_CPUS 1             // only the boot CPU runs the kernel for now
+#define SOFTIRQ_MAX_RESTART 10 // rounds run on an interrupt exit, the idle loop takes what is left
+
+/**
+ * @brief Deferred work raised by the top halves, the lower numbers run first.
+ */
+typedef enum
+{
+    SOFTIRQ_HI,      // high priority tasklets
+    SOFTIRQ_TIMER,
+    SOFTIRQ_TASKLET,
+    NB_SOFTIRQS
+} softirq_t;
+
+#define TASKLET_SCHEDULED 0x1
+
+typedef struct tasklet
+{
+    struct tasklet *next;
+    void (*func)(uint32_t data);
+    uint32_t data;
+    uint32_t state; // TASKLET_SCHEDULED while queued, it can be queued again once it runs
+} tasklet_t;
+
+#define TASKLET_INIT(tasklet_func, tasklet_data) \
+    {.next = NULL, .func = tasklet_func, .data = tasklet_data, .state = 0}
+
+extern volatile uint32_t softirq_pending[MAX_CPUS]; // bits of softirq_t, read by irq_common
+
+void init_softirq(void);
+void open_softirq(softirq_t nr, void (*action)(void));
+void raise_softirq(softirq_t nr);
+void do_softirq(void);
+void tasklet_schedule(tasklet_t *tasklet);
+void tasklet_hi_schedule(tasklet_t *tasklet);
+
+#endif // __SOFTIRQ_H__
\ No newline at end of file
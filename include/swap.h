@@ -0,0 +1,17 @@
+#ifndef __SWAP_H__
+#define __SWAP_H__
+
+#include <stdint.h>
+
+#define SWAP_MAX_SLOTS 16384 // 64 MiB of swap
+#define SWAP_NONE 0xFFFFFFFF
+
+void init_swap(void);
+uint32_t swap_alloc(void);
+void swap_dup(uint32_t slot);
+void swap_free(uint32_t slot);
+int swap_write(uint32_t slot, uint32_t page);
+int swap_read(uint32_t slot, uint32_t page);
+void swap_stats(void);
+
+#endif // __SWAP_H__
\ No newline at end of file
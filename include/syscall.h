@@ -0,0 +1,23 @@
+#ifndef __SYSCALL_H__
+#define __SYSCALL_H__
+
+#include "idt.h"
+
+#define SYSCALL_VECTOR 0x80
+
+// eax holds the number, ebx, ecx and edx the arguments, eax the result
+// sysenter also takes the user stack in esi and the return address in edi, ecx and edx are lost
+#define SYS_WRITE 0
+#define SYS_BRK 1
+#define SYS_PAUSE 2 // lets the kernel idle until the next interrupt
+#define SYS_KLOG 3  // reads the kernel log from a sequence number
+#define SYS_READ 4  // reads a line typed on the keyboard, fd 0 only
+#define SYS_IRQ_STATS 5 // copies the irq_stats_t of a vector, built with IRQ_STATS
+#define SYS_CLOCK_GETTIME 6 // CLOCK_MONOTONIC into a timespec_t
+#define SYS_NANOSLEEP 7 // idles for the delay in a timespec_t
+#define NB_SYSCALLS 8
+
+void init_sysenter(void);
+void syscall_handler(struct regs *r);
+
+#endif // __SYSCALL_H__
\ No newline at end of file
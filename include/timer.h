@@ -0,0 +1,38 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIMER_SHIFT 20 // a wheel slot spans 2^20 ns, about a millisecond
+#define TIMER_LEVEL_BITS 6
+#define TIMER_LEVEL_SIZE (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS 4 // level n slots span 64^n units, the wheel covers 64^4 units, about 4.9 hours
+
+/**
+ * @brief A callback run from the timer softirq once ktime_get passes expires.
+ */
+typedef struct ktimer
+{
+    struct ktimer *next;
+    struct ktimer **pprev; // NULL when not queued
+    uint64_t expires;      // ns since init_clock
+    uint8_t level;
+    uint8_t slot;
+    void (*func)(uint32_t data);
+    uint32_t data;
+} ktimer_t;
+
+void init_timer(void);
+void timer_setup(ktimer_t *timer, void (*func)(uint32_t data), uint32_t data);
+void timer_add(ktimer_t *timer, uint64_t expires);
+int timer_cancel(ktimer_t *timer);
+void timer_sleep(uint64_t ns);
+void timer_stats_dump(void);
+
+static inline int timer_pending(ktimer_t *timer)
+{
+    return timer->pprev != NULL;
+}
+
+#endif // __TIMER_H__
\ No newline at end of file
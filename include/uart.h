@@ -0,0 +1,21 @@
+#ifndef __UART_H__
+#define __UART_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define COM1_PORT 0x3F8
+#define COM1_IRQ 0x24
+#define UART_BAUD 115200
+
+#define UART_TX_RING 4096 // output waiting for the transmit interrupt, a power of 2
+#define UART_RX_RING 256  // input not read yet, a power of 2
+
+void init_uart(void);
+void uart_enable_irq(void);
+void uart_irq_handler(void);
+void uart_write(const char *buffer, size_t len);
+void uart_sync(void);
+int uart_getc(void);
+
+#endif // __UART_H__
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef __VM_H__
+#define __VM_H__
+
+#include <stdint.h>
+#include "mmu.h"
+
+#define VMA_READ 0x1
+#define VMA_WRITE 0x2
+#define VMA_GROWSDOWN 0x4 // a fault right below the area extends it, for stacks
+
+#define USER_STACK_TOP KERNEL_VIRT_BASE
+#define USER_STACK_MAX 0x800000 // 8 MiB
+
+#define PF_PRESENT 0x1 // page fault error code: the page was present, so it is a protection fault
+#define PF_WRITE 0x2
+#define PF_USER 0x4
+
+typedef struct vma
+{
+    uint32_t start; // page aligned, [start, end)
+    uint32_t end;
+    uint32_t flags;
+    uint32_t phys; // physical memory backing the area, 0 to fill it with zeroed pages on demand
+    struct vma *next;
+} vma_t;
+
+typedef struct
+{
+    uint32_t directory; // physical address of the page directory
+    vma_t *vmas;        // sorted by address
+    vma_t *heap;
+    vma_t *stack;
+    uint32_t brk;
+} mm_t;
+
+extern mm_t *current_mm;
+
+void init_vm(void);
+mm_t *mm_create(void);
+mm_t *mm_clone(mm_t *mm);
+void mm_destroy(mm_t *mm);
+vma_t *mm_add_vma(mm_t *mm, uint32_t start, uint32_t end, uint32_t flags, uint32_t phys);
+vma_t *mm_find_vma(mm_t *mm, uint32_t addr);
+uint32_t mm_brk(mm_t *mm, uint32_t brk);
+void mm_switch(mm_t *mm);
+int mm_handle_fault(mm_t *mm, uint32_t addr, uint32_t error);
+void mm_stats(mm_t *mm);
+
+#endif // __VM_H__
\ No newline at end of file
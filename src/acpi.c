@@ -0,0 +1,113 @@
+#include "acpi.h"
+#include "mmu.h"
+#include "multiboot.h"
+#include "lib.h"
+
+#define ACPI_RSDP_V1_SIZE 20
+
+static uint8_t checksum_valid(const void *data, uint32_t size)
+{
+    const uint8_t *bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+/**
+ * @brief Gets a kernel address for an ACPI structure: the direct map when it lies below lowmem_end,
+ * a new write-back mapping otherwise.
+ */
+static void *acpi_map(uint32_t phys_addr, uint32_t size)
+{
+    if (phys_addr + size <= lowmem_end)
+    {
+        return phys_to_virt(phys_addr);
+    }
+    return ioremap(phys_addr, size, MEM_WB);
+}
+
+/**
+ * @brief Maps a whole table from its header, NULL when it cannot be mapped or its checksum is wrong.
+ */
+static acpi_header_t *map_table(uint32_t phys_addr)
+{
+    acpi_header_t *header = acpi_map(phys_addr, sizeof(acpi_header_t));
+    if (header == NULL || header->length < sizeof(acpi_header_t))
+    {
+        return NULL;
+    }
+
+    header = acpi_map(phys_addr, header->length);
+    if (header == NULL || !checksum_valid(header, header->length))
+    {
+        return NULL;
+    }
+    return header;
+}
+
+/**
+ * @brief Gets the RSDP the bootloader copied in the multiboot information, the ACPI 2.0 one first.
+ */
+static acpi_rsdp_t *find_rsdp(void)
+{
+    multiboot_tag_acpi_t *tag = (multiboot_tag_acpi_t *)multiboot_find_tag(MULTIBOOT_TAG_TYPE_ACPI_NEW);
+    if (tag == NULL)
+    {
+        tag = (multiboot_tag_acpi_t *)multiboot_find_tag(MULTIBOOT_TAG_TYPE_ACPI_OLD);
+    }
+    if (tag == NULL)
+    {
+        return NULL;
+    }
+
+    acpi_rsdp_t *rsdp = (acpi_rsdp_t *)tag->rsdp;
+    if (memcmp(rsdp->signature, "RSD PTR ", sizeof(rsdp->signature)) != 0 || !checksum_valid(rsdp, ACPI_RSDP_V1_SIZE))
+    {
+        return NULL;
+    }
+    return rsdp;
+}
+
+/**
+ * @brief Finds an ACPI table through the XSDT, or the RSDT before ACPI 2.0.
+ * @param signature The 4 characters of the table, ACPI_MADT_SIGNATURE for instance.
+ * @return The mapped table, NULL when there is none.
+ */
+void *acpi_find_table(const char *signature)
+{
+    acpi_rsdp_t *rsdp = find_rsdp();
+    if (rsdp == NULL)
+    {
+        return NULL;
+    }
+
+    // the XSDT may sit above 4 GiB, where only the RSDT can be reached from here
+    uint8_t xsdt = rsdp->revision >= 2 && rsdp->xsdt_address != 0 && rsdp->xsdt_address < 0x100000000ULL;
+    acpi_header_t *root = map_table(xsdt ? (uint32_t)rsdp->xsdt_address : rsdp->rsdt_address);
+    if (root == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t entry_size = xsdt ? sizeof(uint64_t) : sizeof(uint32_t);
+    uint32_t nb_entries = (root->length - sizeof(acpi_header_t)) / entry_size;
+    for (uint32_t i = 0; i < nb_entries; i++)
+    {
+        uint64_t address = 0;
+        memcpy(&address, (uint8_t *)(root + 1) + i * entry_size, entry_size);
+        if (address >= 0x100000000ULL)
+        {
+            continue;
+        }
+
+        acpi_header_t *header = acpi_map((uint32_t)address, sizeof(acpi_header_t));
+        if (header != NULL && memcmp(header->signature, signature, sizeof(header->signature)) == 0)
+        {
+            return map_table((uint32_t)address);
+        }
+    }
+    return NULL;
+}
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include "apic.h"
+#include "acpi.h"
+#include "idt.h"
+#include "mmu.h"
+#include "cpu.h"
+#include "cmdline.h"
+#include "klog.h"
+#include "clock.h"
+#include "lib.h"
+
+// local APIC registers, byte offsets
+#define LAPIC_ID 0x20
+#define LAPIC_TPR 0x80 // task priority, 0 accepts every vector
+#define LAPIC_EOI 0xB0
+#define LAPIC_SPURIOUS 0xF0
+#define LAPIC_SPURIOUS_ENABLE 0x100
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+#define LAPIC_TIMER_DIVIDE_16 0x3
+#define LVT_MASKED (1 << 16) // one-shot mode with bits 17-18 clear
+
+#define LAPIC_CALIBRATION_MS 10
+
+// I/O APIC registers, reached through the select and window pair
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_VERSION 0x01 // bits 16-23 hold the last redirection entry
+#define IOAPIC_REDIRECTION(n) (0x10 + 2 * (n))
+
+#define REDIRECTION_ACTIVE_LOW (1 << 13)
+#define REDIRECTION_LEVEL (1 << 15)
+#define REDIRECTION_MASKED (1 << 16)
+
+#define ISA_IRQ_CASCADE 2 // the slave 8259, never raised
+
+typedef struct
+{
+    uint32_t address;
+    volatile uint32_t *registers;
+    uint32_t gsi_base;
+    uint32_t nb_entries;
+} ioapic_t;
+
+typedef struct
+{
+    uint32_t gsi;
+    uint16_t flags; // MADT_POLARITY_* and MADT_TRIGGER_*
+} isa_irq_t;
+
+volatile uint32_t *lapic_eoi = NULL;
+
+static volatile uint32_t *lapic = NULL;
+static uint32_t lapic_timer_khz = 0;
+static ioapic_t ioapics[MAX_IOAPICS];
+static uint32_t nb_ioapics = 0;
+static isa_irq_t isa_irqs[NB_ISA_IRQS];
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / sizeof(uint32_t)];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / sizeof(uint32_t)] = value;
+}
+
+static uint32_t ioapic_read(ioapic_t *ioapic, uint32_t reg)
+{
+    ioapic->registers[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    return ioapic->registers[IOAPIC_WINDOW / sizeof(uint32_t)];
+}
+
+static void ioapic_write(ioapic_t *ioapic, uint32_t reg, uint32_t value)
+{
+    ioapic->registers[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    ioapic->registers[IOAPIC_WINDOW / sizeof(uint32_t)] = value;
+}
+
+uint32_t lapic_id(void)
+{
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+static void apic_spurious_handler(struct regs *r)
+{
+    (void)r; // no end of interrupt for the spurious vector
+}
+
+/**
+ * @brief Reads the local APIC address, the I/O APICs and the ISA interrupt overrides from the MADT.
+ * @return The physical address of the local APIC, 0 without a MADT.
+ */
+static uint32_t parse_madt(void)
+{
+    acpi_madt_t *madt = acpi_find_table(ACPI_MADT_SIGNATURE);
+    if (madt == NULL)
+    {
+        return 0;
+    }
+
+    for (uint32_t irq = 0; irq < NB_ISA_IRQS; irq++)
+    {
+        isa_irqs[irq] = (isa_irq_t){.gsi = irq, .flags = 0};
+    }
+
+    uint32_t lapic_address = madt->lapic_address;
+    uint8_t *entry = madt->entries;
+    uint8_t *end = (uint8_t *)madt + madt->header.length;
+    while (entry + sizeof(madt_entry_t) <= end && ((madt_entry_t *)entry)->length >= sizeof(madt_entry_t))
+    {
+        madt_entry_t *header = (madt_entry_t *)entry;
+        if (header->type == MADT_IOAPIC && nb_ioapics < MAX_IOAPICS)
+        {
+            madt_ioapic_t *ioapic = (madt_ioapic_t *)entry;
+            ioapics[nb_ioapics].address = ioapic->address;
+            ioapics[nb_ioapics].gsi_base = ioapic->gsi_base;
+            nb_ioapics++;
+        }
+        else if (header->type == MADT_INTERRUPT_OVERRIDE)
+        {
+            madt_interrupt_override_t *override = (madt_interrupt_override_t *)entry;
+            if (override->bus == 0 && override->source < NB_ISA_IRQS)
+            {
+                isa_irqs[override->source] = (isa_irq_t){.gsi = override->gsi, .flags = override->flags};
+            }
+        }
+        else if (header->type == MADT_LAPIC_ADDRESS_OVERRIDE)
+        {
+            madt_lapic_address_override_t *override = (madt_lapic_address_override_t *)entry;
+            if (override->address < 0x100000000ULL)
+            {
+                lapic_address = (uint32_t)override->address;
+            }
+        }
+        entry += header->length;
+    }
+    return lapic_address;
+}
+
+static ioapic_t *find_ioapic(uint32_t gsi)
+{
+    for (uint32_t i = 0; i < nb_ioapics; i++)
+    {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].nb_entries)
+        {
+            return &ioapics[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sends every ISA IRQ to its vector of the 8259 days, IRQ_BASE + irq, on this CPU. ISA lines are active
+ * high and edge triggered unless the MADT overrides them.
+ */
+static void route_isa_irqs(void)
+{
+    uint32_t destination = lapic_id() << 24;
+    for (uint32_t irq = 0; irq < NB_ISA_IRQS; irq++)
+    {
+        ioapic_t *ioapic = find_ioapic(isa_irqs[irq].gsi);
+        if (irq == ISA_IRQ_CASCADE || ioapic == NULL)
+        {
+            continue;
+        }
+
+        uint32_t low = IRQ_BASE + irq;
+        if ((isa_irqs[irq].flags & MADT_POLARITY_MASK) == MADT_POLARITY_ACTIVE_LOW)
+        {
+            low |= REDIRECTION_ACTIVE_LOW;
+        }
+        if ((isa_irqs[irq].flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL)
+        {
+            low |= REDIRECTION_LEVEL;
+        }
+
+        uint32_t entry = isa_irqs[irq].gsi - ioapic->gsi_base;
+        ioapic_write(ioapic, IOAPIC_REDIRECTION(entry) + 1, destination);
+        ioapic_write(ioapic, IOAPIC_REDIRECTION(entry), low);
+    }
+}
+
+/**
+ * @brief Moves the IRQs from the 8259 to the local and I/O APICs found in the MADT. The 8259 stays in use
+ * when there is no APIC or with apic=off on the command line.
+ */
+void init_apic(void)
+{
+    char option[8];
+    if (cmdline_get("apic", option, sizeof(option)) >= 0 && strcmp(option, "off") == 0)
+    {
+        klog(KLOG_INFO, "apic: off, IRQs stay on the 8259\n");
+        return;
+    }
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    uint32_t lapic_address = (edx & CPUID_EDX_APIC) ? parse_madt() : 0;
+    if (lapic_address == 0 || nb_ioapics == 0)
+    {
+        klog(KLOG_INFO, "apic: no local and I/O APIC, IRQs stay on the 8259\n");
+        return;
+    }
+
+    lapic = ioremap(lapic_address, PAGE_SIZE, MEM_UC);
+    if (lapic == NULL)
+    {
+        klog(KLOG_WARN, "apic: no room to map the local APIC\n");
+        return;
+    }
+    for (uint32_t i = 0; i < nb_ioapics; i++)
+    {
+        ioapics[i].registers = ioremap(ioapics[i].address, PAGE_SIZE, MEM_UC);
+        if (ioapics[i].registers == NULL)
+        {
+            klog(KLOG_WARN, "apic: no room to map the I/O APIC\n");
+            return;
+        }
+        ioapics[i].nb_entries = ((ioapic_read(&ioapics[i], IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+    }
+
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | MSR_APIC_BASE_ENABLE);
+    lapic_write(LAPIC_TPR, 0);
+    set_int_handler(APIC_SPURIOUS_VECTOR, apic_spurious_handler, 0);
+    lapic_write(LAPIC_SPURIOUS, LAPIC_SPURIOUS_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    mask_pic();
+    route_isa_irqs();
+    lapic_eoi = &lapic[LAPIC_EOI / sizeof(uint32_t)];
+    klog(KLOG_INFO, "apic: local APIC %d at 0x%x, %d I/O APICs\n", lapic_id(), lapic_address, nb_ioapics);
+}
+
+/**
+ * @brief Counts the local APIC timer ticks over LAPIC_CALIBRATION_MS of ktime_get, then leaves the timer
+ * stopped in one-shot mode on vector. Needs the TSC clock.
+ * @return The timer rate in kHz, 0 without a local APIC.
+ */
+uint32_t lapic_timer_init(uint8_t vector)
+{
+    if (lapic == NULL || tsc_khz == 0)
+    {
+        return 0;
+    }
+
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | vector);
+    uint64_t end = ktime_get() + (uint64_t)LAPIC_CALIBRATION_MS * NSEC_PER_MSEC;
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    while (ktime_get() < end)
+        ;
+    uint32_t ticks = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+    lapic_timer_khz = ticks / LAPIC_CALIBRATION_MS;
+    lapic_write(LAPIC_LVT_TIMER, vector);
+    return lapic_timer_khz;
+}
+
+/**
+ * @brief Raises the timer vector once in ns nanoseconds, 0 stops the timer. Delays past 2^32 ns fire
+ * early, the caller reprograms the timer when it does.
+ */
+void lapic_timer_arm(uint64_t ns)
+{
+    if (ns == 0)
+    {
+        lapic_write(LAPIC_TIMER_INITIAL, 0);
+        return;
+    }
+    if (ns > 0xFFFFFFFF)
+    {
+        ns = 0xFFFFFFFF;
+    }
+    uint64_t count = ns * lapic_timer_khz;
+    div64(&count, NSEC_PER_MSEC);
+    lapic_write(LAPIC_TIMER_INITIAL, count == 0 ? 1 : count > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)count);
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "ata.h"
+#include "ioport.h"
+#include "lib.h"
+
+// primary bus, its master drive holds the swap area (the cdrom sits on the secondary bus)
+#define ATA_DATA 0x1F0
+#define ATA_ERROR 0x1F1
+#define ATA_SECTOR_COUNT 0x1F2
+#define ATA_LBA_LOW 0x1F3
+#define ATA_LBA_MID 0x1F4
+#define ATA_LBA_HIGH 0x1F5
+#define ATA_DRIVE 0x1F6
+#define ATA_STATUS 0x1F7
+#define ATA_COMMAND 0x1F7
+#define ATA_CONTROL 0x3F6
+
+#define ATA_STATUS_ERR 0x01
+#define ATA_STATUS_DRQ 0x08
+#define ATA_STATUS_DF 0x20
+#define ATA_STATUS_BSY 0x80
+
+#define ATA_CMD_READ_SECTORS 0x20
+#define ATA_CMD_WRITE_SECTORS 0x30
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+
+#define ATA_CONTROL_NIEN 0x02 // no interrupts, the driver polls
+
+#define ATA_TIMEOUT 1000000
+
+static uint32_t nb_sectors = 0; // 0 when there is no drive
+
+/**
+ * @brief Waits for the drive to leave BSY, and to raise DRQ if data is expected.
+ * @return 0 when ready, -1 on error or timeout.
+ */
+static int ata_wait(uint8_t data)
+{
+    for (uint32_t i = 0; i < ATA_TIMEOUT; i++)
+    {
+        uint8_t status = inb(ATA_STATUS);
+        if (status & ATA_STATUS_BSY)
+        {
+            continue;
+        }
+        if (status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+        {
+            return -1;
+        }
+        if (!data || (status & ATA_STATUS_DRQ))
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void ata_select(uint32_t lba, uint8_t count)
+{
+    outb(ATA_DRIVE, 0xE0 | ((lba >> 24) & 0x0F)); // master, LBA28
+    outb(ATA_SECTOR_COUNT, count);
+    outb(ATA_LBA_LOW, lba & 0xFF);
+    outb(ATA_LBA_MID, (lba >> 8) & 0xFF);
+    outb(ATA_LBA_HIGH, (lba >> 16) & 0xFF);
+}
+
+/**
+ * @brief Identifies the primary master drive.
+ * @return 0 if a disk is there, -1 otherwise.
+ */
+int ata_init(void)
+{
+    outb(ATA_CONTROL, ATA_CONTROL_NIEN);
+    ata_select(0, 0);
+    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    if (inb(ATA_STATUS) == 0)
+    {
+        return -1; // no drive
+    }
+    // ATAPI and SATA devices set the LBA registers instead of answering IDENTIFY
+    if (ata_wait(0) != 0 || inb(ATA_LBA_MID) != 0 || inb(ATA_LBA_HIGH) != 0 || ata_wait(1) != 0)
+    {
+        return -1;
+    }
+
+    uint16_t identify[ATA_SECTOR_SIZE / sizeof(uint16_t)];
+    for (uint32_t i = 0; i < ATA_SECTOR_SIZE / sizeof(uint16_t); i++)
+    {
+        identify[i] = inw(ATA_DATA);
+    }
+    nb_sectors = identify[60] | (uint32_t)identify[61] << 16; // LBA28 addressable sectors
+    return nb_sectors != 0 ? 0 : -1;
+}
+
+uint32_t ata_sectors(void)
+{
+    return nb_sectors;
+}
+
+int ata_read(uint32_t lba, uint8_t count, void *buf)
+{
+    if (lba + count > nb_sectors)
+    {
+        return -1;
+    }
+
+    uint16_t *words = buf;
+    ata_select(lba, count);
+    outb(ATA_COMMAND, ATA_CMD_READ_SECTORS);
+    for (uint8_t sector = 0; sector < count; sector++)
+    {
+        if (ata_wait(1) != 0)
+        {
+            return -1;
+        }
+        for (uint32_t i = 0; i < ATA_SECTOR_SIZE / sizeof(uint16_t); i++)
+        {
+            *words++ = inw(ATA_DATA);
+        }
+    }
+    return 0;
+}
+
+int ata_write(uint32_t lba, uint8_t count, const void *buf)
+{
+    if (lba + count > nb_sectors)
+    {
+        return -1;
+    }
+
+    const uint16_t *words = buf;
+    ata_select(lba, count);
+    outb(ATA_COMMAND, ATA_CMD_WRITE_SECTORS);
+    for (uint8_t sector = 0; sector < count; sector++)
+    {
+        if (ata_wait(1) != 0)
+        {
+            return -1;
+        }
+        for (uint32_t i = 0; i < ATA_SECTOR_SIZE / sizeof(uint16_t); i++)
+        {
+            outw(ATA_DATA, *words++);
+        }
+    }
+    outb(ATA_COMMAND, ATA_CMD_CACHE_FLUSH);
+    return ata_wait(0);
+}
\ No newline at end of file
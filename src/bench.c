@@ -0,0 +1,221 @@
+#include "bench.h"
+#include "mmu.h"
+#include "buddy.h"
+#include "cpu.h"
+#include "mem.h"
+#include "lib.h"
+#include "idt.h"
+#include "klog.h"
+
+#define BENCH_PAGES 32 // kernel pages touched after each switch, as a task going back to kernel work would
+#define BENCH_MEM_ORDER 4 // 64 KiB buffers, the largest size class
+#define BENCH_MEM_RUNS 8  // the fastest run is kept, the first ones warm the caches
+#define BENCH_VECTOR 0xF0
+#define BENCH_LEGACY_VECTOR 0xF1 // also in isr_legacy_stub
+#define BENCH_INTERRUPT_RUNS 10000
+
+static volatile uint32_t bench_sink;
+
+/**
+ * @brief Reads one word in each page of the kernel image, mapped with 4Ko pages, so every TLB miss costs a page walk.
+ */
+static void touch_kernel_pages(void)
+{
+    extern char _ro_start;
+    extern char _ro_end;
+    uint32_t nb_pages = (&_ro_end - &_ro_start) / PAGE_SIZE;
+    for (uint32_t i = 0; i < BENCH_PAGES; i++)
+    {
+        bench_sink += *(volatile uint32_t *)(&_ro_start + (i % nb_pages) * PAGE_SIZE);
+    }
+}
+
+/**
+ * @brief Gets the average cycles of a switch to another address space and back, each followed by the kernel page accesses.
+ */
+static uint32_t measure_switch(uint32_t directory, uint32_t iterations)
+{
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        switch_address_space(directory);
+        touch_kernel_pages();
+        switch_address_space(kernel_directory);
+        touch_kernel_pages();
+    }
+    // no 64 bits division without libgcc, the run stays far below 2^32 cycles
+    uint32_t elapsed = (uint32_t)(rdtsc() - start);
+    return elapsed / (iterations * 2);
+}
+
+/**
+ * @brief Compares address space switches with and without global kernel pages, and the cost of a switch to the current directory.
+ */
+void bench_address_space_switch(uint32_t iterations)
+{
+    uint32_t directory = create_address_space();
+    if (directory == 0)
+    {
+        printf("bench: no page for the page directory\n");
+        return;
+    }
+
+    touch_kernel_pages();
+    uint32_t global = measure_switch(directory, iterations);
+
+    set_global_pages(0);
+    touch_kernel_pages();
+    uint32_t no_global = measure_switch(directory, iterations);
+    set_global_pages(1);
+
+    uint32_t same = measure_switch(kernel_directory, iterations);
+
+    printf("switch: %d cycles global, %d cycles not global, %d cycles same directory\n", global, no_global, same);
+    destroy_address_space(directory);
+}
+
+static const uint32_t mem_sizes[] = {16, 64, 256, 1024, 4096, 16384, 65536};
+
+/**
+ * @brief Gets the fewest cycles of a fill (src NULL) or a copy of size bytes over the runs.
+ */
+static uint32_t measure_mem(mem_impl_t impl, uint8_t *dest, const uint8_t *src, uint32_t size)
+{
+    uint32_t best = 0xFFFFFFFF;
+    for (uint32_t run = 0; run < BENCH_MEM_RUNS; run++)
+    {
+        uint64_t start = rdtsc();
+        if (src == NULL)
+        {
+            memset_impl(impl, dest, run, size);
+        }
+        else
+        {
+            memcpy_impl(impl, dest, src, size);
+        }
+        uint32_t elapsed = (uint32_t)(rdtsc() - start);
+        if (elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+    return best != 0 ? best : 1;
+}
+
+static void print_mem_table(const char *name, uint8_t *dest, const uint8_t *src)
+{
+    printf("%s bytes/cycle:\n", name);
+    for (uint32_t i = 0; i < sizeof(mem_sizes) / sizeof(mem_sizes[0]); i++)
+    {
+        printf("%d:", mem_sizes[i]);
+        for (mem_impl_t impl = 0; impl < NB_MEM_IMPLS; impl++)
+        {
+            if (!mem_impl_supported(impl))
+            {
+                continue;
+            }
+            // hundredths of bytes per cycle, there is no floating point in the kernel
+            uint32_t ratio = mem_sizes[i] * 100 / measure_mem(impl, dest, src, mem_sizes[i]);
+            printf(" %s %d.%02d", mem_impl_name(impl), ratio / 100, ratio % 100);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * @brief Prints the throughput of every memset and memcpy variant the CPU supports for each size class.
+ */
+void bench_mem(void)
+{
+    uint32_t dest = alloc_pages(BENCH_MEM_ORDER);
+    uint32_t src = alloc_pages(BENCH_MEM_ORDER);
+    if (dest == 0 || src == 0)
+    {
+        printf("bench: no pages for the memory buffers\n");
+        if (dest != 0)
+        {
+            free_pages(dest, BENCH_MEM_ORDER);
+        }
+        if (src != 0)
+        {
+            free_pages(src, BENCH_MEM_ORDER);
+        }
+        return;
+    }
+
+    print_mem_table("memset", phys_to_virt(dest), NULL);
+    print_mem_table("memcpy", phys_to_virt(dest), phys_to_virt(src));
+
+    free_pages(dest, BENCH_MEM_ORDER);
+    free_pages(src, BENCH_MEM_ORDER);
+}
+
+typedef void (*idt_handler_t)(struct regs *r);
+
+static void *legacy_handlers[208]; // the vectors from 0x28, less the 8 slave IRQs, as the table before the stubs
+
+#define LEGACY_INDEX(i) ((i > 0x27 && i < 0x70) ? (i - 0x28) : (i - 0x30))
+
+static void bench_nop_handler(struct regs *r)
+{
+    (void)r;
+}
+
+/**
+ * @brief The C dispatch of the interrupts before the per-vector stubs, called by isr_legacy_stub.
+ */
+void bench_legacy_dispatch(struct regs *r)
+{
+    uint8_t handler_index = LEGACY_INDEX((uint8_t)r->int_no);
+    if (legacy_handlers[handler_index] != NULL)
+    {
+        idt_handler_t handler = legacy_handlers[handler_index];
+        handler(r);
+    }
+    else
+    {
+        klog(KLOG_WARN, "Unhandled interrupt : 0x%x\n", r->int_no);
+    }
+}
+
+/**
+ * @brief Gets the average cycles of a software interrupt from the kernel going to a handler doing nothing.
+ */
+static uint32_t measure_interrupt(uint8_t legacy)
+{
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_INTERRUPT_RUNS; i++)
+    {
+        if (legacy)
+        {
+            __asm__ volatile("int %0" ::"i"(BENCH_LEGACY_VECTOR) : "memory");
+        }
+        else
+        {
+            __asm__ volatile("int %0" ::"i"(BENCH_VECTOR) : "memory");
+        }
+    }
+    return (uint32_t)(rdtsc() - start) / BENCH_INTERRUPT_RUNS;
+}
+
+/**
+ * @brief Compares the per-vector stubs with the former dispatch through isr_handler and a C lookup.
+ */
+void bench_interrupts(void)
+{
+    extern void isr_legacy_stub(void);
+
+    set_int_handler(BENCH_VECTOR, bench_nop_handler, 0);
+    legacy_handlers[LEGACY_INDEX(BENCH_LEGACY_VECTOR)] = bench_nop_handler;
+    set_idt_gate(BENCH_LEGACY_VECTOR, isr_legacy_stub, 0);
+
+    measure_interrupt(0);
+    uint32_t direct = measure_interrupt(0);
+    measure_interrupt(1);
+    uint32_t legacy = measure_interrupt(1);
+    printf("interrupt: %d cycles per-vector stub, %d cycles former dispatch, %d saved\n", direct, legacy, (int)(legacy - direct));
+
+    set_int_handler(BENCH_VECTOR, NULL, 0);
+    extern void (*const isr_stubs[])(void);
+    set_idt_gate(BENCH_LEGACY_VECTOR, isr_stubs[BENCH_LEGACY_VECTOR], 0);
+}
\ No newline at end of file
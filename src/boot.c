@@ -1,18 +1,59 @@
 #include "mmu.h"
+#include "mem.h"
+#include "uart.h"
 #include "screen.h"
-
-#define CR0_PG 0x80000000
+#include "buddy.h"
+#include "slab.h"
+#include "vm.h"
+#include "rmap.h"
+#include "fbcon.h"
+#include "multiboot.h"
 
 extern void main(void);
 
-void kernel_main(void)
+multiboot_info_t *multiboot_info = NULL; // physical address given by the bootloader
+
+multiboot_tag_t *multiboot_find_tag(uint32_t type)
+{
+    if (multiboot_info == NULL)
+    {
+        return NULL;
+    }
+
+    multiboot_info_t *info = phys_to_virt((uint32_t)multiboot_info);
+    multiboot_tag_t *tag = (multiboot_tag_t *)(info + 1);
+    while (tag->type != MULTIBOOT_TAG_TYPE_END)
+    {
+        if (tag->type == type)
+        {
+            return tag;
+        }
+        tag = MULTIBOOT_TAG_NEXT(tag);
+    }
+    return NULL;
+}
+
+void kernel_main(uint32_t magic, multiboot_info_t *info)
 {
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC)
+    {
+        multiboot_info = info;
+    }
+
     // init_screen();
+    init_uart();
+    init_mem();
     init_mmu();
-    MMU_ENABLE();
+    enable_mmu();
+    mmu_dump();
+    init_buddy();
+    init_fbcon();
+    init_slab();
+    init_vm();
+    init_rmap();
     printf("ici\n");
     __asm__ volatile("movl $_kernel_stack_top, %esp\nmovl $_kernel_stack_top, %ebp");
     main();
     for (;;)
         ;
-}
+}
\ No newline at end of file
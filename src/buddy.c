@@ -0,0 +1,401 @@
+#include "buddy.h"
+#include "mmu.h"
+#include "cpu.h"
+
+#define BLOCK_PAGES(order) (1 << (order))
+
+typedef struct
+{
+    uint32_t start_pfn;
+    uint32_t end_pfn;
+    uint32_t free_lists[MAX_ORDER + 1]; // head pfn of each order, NO_FRAME when empty
+    uint32_t nb_free[MAX_ORDER + 1];
+    uint32_t free_pages;
+} zone_t;
+
+typedef struct
+{
+    uint32_t pages[ZERO_POOL_SIZE]; // zeroed pages taken out of the free lists
+    uint32_t nb_pages;
+    uint32_t hits;
+    uint32_t misses;
+} zero_pool_t;
+
+frame_t *mem_map = NULL;
+uint32_t max_pfn = 0;
+
+static zone_t zones[NB_ZONES];
+static zero_pool_t zero_pools[NB_ZONES];
+
+static zone_t *pfn_to_zone(uint32_t pfn)
+{
+    return pfn < zones[ZONE_NORMAL].end_pfn ? &zones[ZONE_NORMAL] : &zones[ZONE_HIGHMEM];
+}
+
+static void list_add(zone_t *zone, uint32_t pfn, uint8_t order)
+{
+    frame_t *frame = &mem_map[pfn];
+    frame->flags = FRAME_FREE;
+    frame->order = order;
+    frame->prev = NO_FRAME;
+    frame->next = zone->free_lists[order];
+    if (frame->next != NO_FRAME)
+    {
+        mem_map[frame->next].prev = pfn;
+    }
+    zone->free_lists[order] = pfn;
+    zone->nb_free[order]++;
+    zone->free_pages += BLOCK_PAGES(order);
+}
+
+static void list_remove(zone_t *zone, uint32_t pfn, uint8_t order)
+{
+    frame_t *frame = &mem_map[pfn];
+    if (frame->prev != NO_FRAME)
+    {
+        mem_map[frame->prev].next = frame->next;
+    }
+    else
+    {
+        zone->free_lists[order] = frame->next;
+    }
+    if (frame->next != NO_FRAME)
+    {
+        mem_map[frame->next].prev = frame->prev;
+    }
+    frame->flags &= ~FRAME_FREE;
+    zone->nb_free[order]--;
+    zone->free_pages -= BLOCK_PAGES(order);
+}
+
+/**
+ * @brief Puts a block back in its zone, merging it with its buddy as long as the buddy is a free block of the same order.
+ */
+static void free_block(uint32_t pfn, uint8_t order)
+{
+    zone_t *zone = pfn_to_zone(pfn);
+    while (order < MAX_ORDER)
+    {
+        uint32_t buddy = pfn ^ BLOCK_PAGES(order);
+        if (buddy < zone->start_pfn || buddy >= zone->end_pfn)
+        {
+            break;
+        }
+
+        frame_t *frame = &mem_map[buddy];
+        if (!(frame->flags & FRAME_FREE) || frame->order != order)
+        {
+            break;
+        }
+        list_remove(zone, buddy, order);
+        pfn &= ~BLOCK_PAGES(order);
+        order++;
+    }
+    list_add(zone, pfn, order);
+}
+
+/**
+ * @brief Releases [start_pfn, end_pfn) as the biggest naturally aligned blocks it can hold.
+ */
+static void free_range(uint32_t start_pfn, uint32_t end_pfn)
+{
+    while (start_pfn < end_pfn)
+    {
+        uint8_t order = 0;
+        while (order < MAX_ORDER && (start_pfn & (BLOCK_PAGES(order + 1) - 1)) == 0 && start_pfn + BLOCK_PAGES(order + 1) <= end_pfn)
+        {
+            order++;
+        }
+        free_block(start_pfn, order);
+        start_pfn += BLOCK_PAGES(order);
+    }
+}
+
+/**
+ * @brief Releases a free memory region, skipping the pages taken by the boot allocator and splitting it at the zone boundary.
+ */
+static void release_region(uint32_t start, uint32_t end, uint32_t boot_start, uint32_t boot_end)
+{
+    if (boot_start < end && boot_end > start)
+    {
+        if (start < boot_start)
+        {
+            release_region(start, boot_start, 0, 0);
+        }
+        if (boot_end < end)
+        {
+            release_region(boot_end, end, 0, 0);
+        }
+        return;
+    }
+
+    uint32_t start_pfn = ADDR_TO_PAGE(start);
+    uint32_t end_pfn = ADDR_TO_PAGE(end);
+    uint32_t boundary = zones[ZONE_NORMAL].end_pfn;
+    if (start_pfn < boundary && end_pfn > boundary)
+    {
+        free_range(start_pfn, boundary);
+        free_range(boundary, end_pfn);
+    }
+    else
+    {
+        free_range(start_pfn, end_pfn);
+    }
+}
+
+void init_buddy(void)
+{
+    for (uint32_t i = 0; i < nb_memory_regions; i++)
+    {
+        if (ADDR_TO_PAGE(memory_regions[i].end) > max_pfn)
+        {
+            max_pfn = ADDR_TO_PAGE(memory_regions[i].end);
+        }
+    }
+
+    uint32_t lowmem_pfn = ADDR_TO_PAGE(lowmem_end);
+    zones[ZONE_NORMAL].start_pfn = 0;
+    zones[ZONE_NORMAL].end_pfn = lowmem_pfn < max_pfn ? lowmem_pfn : max_pfn;
+    zones[ZONE_HIGHMEM].start_pfn = zones[ZONE_NORMAL].end_pfn;
+    zones[ZONE_HIGHMEM].end_pfn = max_pfn;
+    for (int zone = 0; zone < NB_ZONES; zone++)
+    {
+        for (int order = 0; order <= MAX_ORDER; order++)
+        {
+            zones[zone].free_lists[order] = NO_FRAME;
+        }
+    }
+
+    uint32_t map_size = PAGE_ALIGN_UP(max_pfn * sizeof(frame_t));
+    uint32_t map_addr = boot_alloc_pages(map_size / PAGE_SIZE);
+    if (map_addr == 0)
+    {
+        printf("buddy: no room for the frame map (%d KiB)\n", map_size / 1024);
+        for (;;)
+            ;
+    }
+    mem_map = phys_to_virt(map_addr);
+    memset(mem_map, 0, map_size);
+
+    // from now on the boot allocator is frozen, the buddy owns every other free page
+    uint32_t boot_start, boot_end;
+    boot_alloc_range(&boot_start, &boot_end);
+    for (uint32_t i = 0; i < nb_memory_regions; i++)
+    {
+        release_region(memory_regions[i].start, memory_regions[i].end, boot_start, boot_end);
+    }
+
+    printf("buddy: %d KiB free, %d KiB highmem\n",
+           (zones[ZONE_NORMAL].free_pages + zones[ZONE_HIGHMEM].free_pages) * (PAGE_SIZE / 1024),
+           zones[ZONE_HIGHMEM].free_pages * (PAGE_SIZE / 1024));
+}
+
+uint32_t alloc_pages_zone(zone_type_t zone_type, uint8_t order)
+{
+    if (order > MAX_ORDER)
+    {
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+    zone_t *zone = &zones[zone_type];
+    uint8_t current = order;
+    while (current <= MAX_ORDER && zone->free_lists[current] == NO_FRAME)
+    {
+        current++;
+    }
+    if (current > MAX_ORDER && order == 0 && zero_pools[zone_type].nb_pages > 0)
+    {
+        // the pool pages are free pages too
+        uint32_t page = zero_pools[zone_type].pages[--zero_pools[zone_type].nb_pages];
+        irq_restore(flags);
+        return page;
+    }
+    if (current > MAX_ORDER)
+    {
+        irq_restore(flags);
+        return 0;
+    }
+
+    uint32_t pfn = zone->free_lists[current];
+    list_remove(zone, pfn, current);
+    while (current > order)
+    {
+        current--;
+        list_add(zone, pfn + BLOCK_PAGES(current), current);
+    }
+
+    mem_map[pfn].order = order;
+    mem_map[pfn].flags = 0;
+    mem_map[pfn].refcount = 1;
+    irq_restore(flags);
+    return pfn * PAGE_SIZE;
+}
+
+uint32_t alloc_pages(uint8_t order)
+{
+    return alloc_pages_zone(ZONE_NORMAL, order);
+}
+
+void free_pages(uint32_t addr, uint8_t order)
+{
+    if (addr == 0)
+    {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    uint32_t pfn = ADDR_TO_PAGE(addr);
+    mem_map[pfn].refcount = 0;
+    free_block(pfn, order);
+    irq_restore(flags);
+}
+
+uint32_t alloc_page(void)
+{
+    return alloc_pages_zone(ZONE_NORMAL, 0);
+}
+
+/**
+ * @brief Allocates a page for user mappings, highmem first so the direct mapped zone stays for the kernel.
+ */
+uint32_t alloc_highmem_page(void)
+{
+    uint32_t page = alloc_pages_zone(ZONE_HIGHMEM, 0);
+    return page != 0 ? page : alloc_pages_zone(ZONE_NORMAL, 0);
+}
+
+void free_page(uint32_t addr)
+{
+    free_pages(addr, 0);
+}
+
+static uint32_t zero_frame(uint32_t page)
+{
+    void *addr = kmap(page);
+    if (addr == NULL)
+    {
+        free_page(page);
+        return 0;
+    }
+    memset(addr, 0, PAGE_SIZE); // page sized fills use non temporal stores
+    kunmap(addr);
+    return page;
+}
+
+/**
+ * @brief Takes a zeroed page from the pool of a zone, zeroing one on the spot when the pool is empty.
+ */
+static uint32_t alloc_zeroed_page_zone(zone_type_t zone_type)
+{
+    uint32_t flags = irq_save();
+    zero_pool_t *pool = &zero_pools[zone_type];
+    if (pool->nb_pages > 0)
+    {
+        uint32_t page = pool->pages[--pool->nb_pages];
+        pool->hits++;
+        irq_restore(flags);
+        return page;
+    }
+    pool->misses++;
+    irq_restore(flags);
+
+    uint32_t page = alloc_pages_zone(zone_type, 0);
+    return page != 0 ? zero_frame(page) : 0;
+}
+
+uint32_t alloc_zeroed_page(void)
+{
+    return alloc_zeroed_page_zone(ZONE_NORMAL);
+}
+
+/**
+ * @brief Allocates a zeroed page for user mappings, highmem first.
+ */
+uint32_t alloc_zeroed_highmem_page(void)
+{
+    if (zones[ZONE_HIGHMEM].end_pfn > zones[ZONE_HIGHMEM].start_pfn)
+    {
+        uint32_t page = alloc_zeroed_page_zone(ZONE_HIGHMEM);
+        if (page != 0)
+        {
+            return page;
+        }
+    }
+    return alloc_zeroed_page_zone(ZONE_NORMAL);
+}
+
+/**
+ * @brief Fills the zeroed page pools, from the idle loop so the zeroing stays off the allocation path.
+ * Interrupts stay enabled while a page is zeroed.
+ */
+void zero_pool_refill(void)
+{
+    for (int zone = 0; zone < NB_ZONES; zone++)
+    {
+        zero_pool_t *pool = &zero_pools[zone];
+        // an empty zone would hand the pool pages back
+        while (pool->nb_pages < ZERO_POOL_SIZE && zones[zone].free_pages > 0)
+        {
+            uint32_t page = alloc_pages_zone(zone, 0);
+            if (page == 0 || zero_frame(page) == 0)
+            {
+                break;
+            }
+
+            uint32_t flags = irq_save();
+            if (pool->nb_pages < ZERO_POOL_SIZE)
+            {
+                pool->pages[pool->nb_pages++] = page;
+                page = 0;
+            }
+            irq_restore(flags);
+            free_page(page);
+        }
+    }
+}
+
+/**
+ * @brief Takes one more reference on a page shared between address spaces.
+ */
+void get_page(uint32_t addr)
+{
+    uint32_t flags = irq_save();
+    mem_map[ADDR_TO_PAGE(addr)].refcount++;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Drops a reference on a page, freeing it with the last one.
+ */
+void put_page(uint32_t addr)
+{
+    uint32_t flags = irq_save();
+    frame_t *frame = &mem_map[ADDR_TO_PAGE(addr)];
+    if (--frame->refcount == 0)
+    {
+        free_block(ADDR_TO_PAGE(addr), frame->order);
+    }
+    irq_restore(flags);
+}
+
+frame_t *addr_to_frame(uint32_t addr)
+{
+    return &mem_map[ADDR_TO_PAGE(addr)];
+}
+
+void buddy_stats(void)
+{
+    const char *names[NB_ZONES] = {"normal", "highmem"};
+    for (int zone = 0; zone < NB_ZONES; zone++)
+    {
+        printf("%s:", names[zone]);
+        for (int order = 0; order <= MAX_ORDER; order++)
+        {
+            printf(" %d", zones[zone].nb_free[order]);
+        }
+        printf(" (%d pages free)\n", zones[zone].free_pages);
+        printf("%s zero pool: %d pages, %d hits, %d misses\n",
+               names[zone], zero_pools[zone].nb_pages, zero_pools[zone].hits, zero_pools[zone].misses);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "clock.h"
+#include "acpi.h"
+#include "ioport.h"
+#include "mmu.h"
+#include "cpu.h"
+#include "klog.h"
+#include "lib.h"
+
+#define PIT_CHANNEL2 0x42
+#define PIT_CHANNEL0_RATE_GENERATOR 0x34 // low then high byte, mode 2
+#define PIT_CHANNEL2_ONE_SHOT 0xB0       // low then high byte, mode 0
+#define PIT_PORT_B 0x61
+#define PORT_B_GATE2 0x1
+#define PORT_B_SPEAKER 0x2
+#define PORT_B_OUT2 0x20
+
+// HPET registers, byte offsets
+#define HPET_CAPABILITIES_PERIOD 0x04 // femtoseconds per tick, high half of the capabilities
+#define HPET_CONFIG 0x10
+#define HPET_CONFIG_ENABLE 0x1
+#define HPET_COUNTER 0xF0
+#define HPET_MAX_PERIOD 100000000 // 100 ns
+#define FSEC_PER_NSEC 1000000
+#define FSEC_PER_MSEC 1000000000000ULL
+
+#define CALIBRATION_MS 10
+
+volatile uint32_t jiffies = 0;
+uint32_t tsc_khz = 0;
+
+// ktime_get() = (rdtsc() - tsc_base) * tsc_mult >> tsc_shift
+static uint64_t tsc_base;
+static uint32_t tsc_mult;
+static uint32_t tsc_shift;
+
+static void pit_set_rate(uint32_t hz)
+{
+    uint32_t divisor = PIT_FREQUENCY / hz;
+    outb(PIT_COMMAND, PIT_CHANNEL0_RATE_GENERATOR);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, divisor >> 8);
+}
+
+/**
+ * @brief Counts the TSC cycles while the PIT channel 2, the speaker one, counts down CALIBRATION_MS.
+ */
+static uint32_t pit_calibrate_tsc(void)
+{
+    uint32_t count = PIT_FREQUENCY * CALIBRATION_MS / 1000;
+    outb(PIT_PORT_B, (inb(PIT_PORT_B) & ~PORT_B_SPEAKER) | PORT_B_GATE2);
+    outb(PIT_COMMAND, PIT_CHANNEL2_ONE_SHOT);
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, count >> 8);
+
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_PORT_B) & PORT_B_OUT2))
+        ;
+    uint64_t cycles = rdtsc() - start;
+    div64(&cycles, CALIBRATION_MS);
+    return (uint32_t)cycles;
+}
+
+/**
+ * @brief Counts the TSC cycles over CALIBRATION_MS of the HPET main counter.
+ * @return The TSC rate in kHz, 0 without a HPET.
+ */
+static uint32_t hpet_calibrate_tsc(void)
+{
+    acpi_hpet_t *table = acpi_find_table(ACPI_HPET_SIGNATURE);
+    if (table == NULL || table->address >= 0x100000000ULL)
+    {
+        return 0;
+    }
+    volatile uint32_t *hpet = ioremap((uint32_t)table->address, PAGE_SIZE, MEM_UC);
+    if (hpet == NULL)
+    {
+        return 0;
+    }
+    uint32_t period = hpet[HPET_CAPABILITIES_PERIOD / sizeof(uint32_t)];
+    if (period == 0 || period > HPET_MAX_PERIOD)
+    {
+        return 0;
+    }
+    hpet[HPET_CONFIG / sizeof(uint32_t)] |= HPET_CONFIG_ENABLE;
+
+    uint64_t window = FSEC_PER_MSEC * CALIBRATION_MS;
+    div64(&window, period);
+
+    // the low half of the counter is enough for the window, the subtraction handles its wrap
+    volatile uint32_t *counter = &hpet[HPET_COUNTER / sizeof(uint32_t)];
+    uint32_t start_ticks = *counter;
+    uint64_t start = rdtsc();
+    uint32_t ticks;
+    while ((ticks = *counter - start_ticks) < (uint32_t)window)
+        ;
+    uint64_t cycles = rdtsc() - start;
+
+    uint64_t elapsed_ns = (uint64_t)ticks * period;
+    div64(&elapsed_ns, FSEC_PER_NSEC);
+    cycles *= NSEC_PER_MSEC;
+    div64(&cycles, (uint32_t)elapsed_ns);
+    return (uint32_t)cycles;
+}
+
+/**
+ * @brief Picks the largest shift keeping tsc_mult in 32 bits, for the most precise conversion.
+ */
+static void set_tsc_scale(uint32_t khz)
+{
+    for (tsc_shift = 32; tsc_shift > 0; tsc_shift--)
+    {
+        uint64_t mult = (uint64_t)NSEC_PER_MSEC << tsc_shift;
+        div64(&mult, khz);
+        if ((mult >> 32) == 0)
+        {
+            tsc_mult = (uint32_t)mult;
+            return;
+        }
+    }
+    tsc_mult = NSEC_PER_MSEC / khz;
+}
+
+static uint8_t tsc_invariant(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_EXTENDED_MAX, &eax, &ebx, &ecx, &edx);
+    if (eax < CPUID_POWER_MANAGEMENT)
+    {
+        return 0;
+    }
+    cpuid(CPUID_POWER_MANAGEMENT, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EDX_INVARIANT_TSC) != 0;
+}
+
+/**
+ * @brief Starts the PIT at HZ and calibrates the TSC against the HPET, or the PIT without one. Called with
+ * the interrupts disabled, init_timer handles the PIT interrupt.
+ */
+void init_clock(void)
+{
+    pit_set_rate(HZ);
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_TSC))
+    {
+        klog(KLOG_INFO, "clock: no TSC, ktime_get counts the %d Hz ticks\n", HZ);
+        return;
+    }
+
+    const char *reference = "HPET";
+    uint32_t khz = hpet_calibrate_tsc();
+    if (khz == 0)
+    {
+        reference = "PIT";
+        khz = pit_calibrate_tsc();
+    }
+    set_tsc_scale(khz);
+    tsc_base = rdtsc();
+    tsc_khz = khz;
+    klog(KLOG_INFO, "clock: TSC at %u kHz against the %s%s\n", khz, reference, tsc_invariant() ? "" : ", not invariant");
+}
+
+/**
+ * @brief Gets the nanoseconds since init_clock from a TSC delta. cycles * tsc_mult takes up to 96 bits,
+ * it is done on both 32 bits halves of cycles.
+ */
+uint64_t ktime_get(void)
+{
+    if (tsc_khz == 0)
+    {
+        return (uint64_t)jiffies * NSEC_PER_TICK;
+    }
+
+    uint64_t cycles = rdtsc() - tsc_base;
+    uint64_t low = (uint64_t)(uint32_t)cycles * tsc_mult;
+    uint64_t high = (uint64_t)(uint32_t)(cycles >> 32) * tsc_mult;
+    return (high << (32 - tsc_shift)) + (low >> tsc_shift);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "cmdline.h"
+#include "multiboot.h"
+
+/**
+ * @brief Finds a key=value option in the kernel command line, options are separated by spaces.
+ * @return the length of the value copied and nul terminated in value, truncated to size - 1,
+ * -1 when the option is not given.
+ */
+int cmdline_get(const char *key, char *value, size_t size)
+{
+    multiboot_tag_string_t *tag = (multiboot_tag_string_t *)multiboot_find_tag(MULTIBOOT_TAG_TYPE_CMDLINE);
+    if (tag == NULL || size == 0)
+    {
+        return -1;
+    }
+
+    const char *option = tag->string;
+    while (*option != '\0')
+    {
+        const char *k = key;
+        const char *c = option;
+        while (*k != '\0' && *c == *k)
+        {
+            k++;
+            c++;
+        }
+        if (*k == '\0' && *c == '=')
+        {
+            c++;
+            size_t len = 0;
+            while (c[len] != '\0' && c[len] != ' ' && len < size - 1)
+            {
+                value[len] = c[len];
+                len++;
+            }
+            value[len] = '\0';
+            return len;
+        }
+
+        while (*option != '\0' && *option != ' ')
+        {
+            option++;
+        }
+        while (*option == ' ')
+        {
+            option++;
+        }
+    }
+    return -1;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "console.h"
+#include "screen.h"
+#include "uart.h"
+#include "fbcon.h"
+#include "mmu.h"
+#include "lib.h"
+
+#define CONSOLE_PRINTF_LINE 128 // longer lines are truncated
+
+static uint8_t console_outputs = CONSOLE_ALL;
+
+void console_set_outputs(uint8_t outputs)
+{
+    console_outputs = outputs;
+}
+
+/**
+ * @brief Writes a batch of text to the console, every output of the kernel goes through here
+ * so that the devices behind it update their state once per batch.
+ */
+void console_write(const char *buffer, size_t len)
+{
+    console_write_to(console_outputs, buffer, len);
+}
+
+void console_write_to(uint8_t outputs, const char *buffer, size_t len)
+{
+    if (outputs & CONSOLE_SCREEN)
+    {
+        // fbcon lives in the higher half, out of reach of the boot code before paging
+        if (direct_map_offset != 0 && fbcon_active())
+        {
+            fbcon_write(buffer, len);
+        }
+        else
+        {
+            screen_write(buffer, len);
+        }
+    }
+    if (outputs & CONSOLE_SERIAL)
+    {
+        uart_write(buffer, len);
+    }
+}
+
+/**
+ * @brief Formats a line for some of the outputs only, the serial line for the debug monitor for instance.
+ */
+void console_printf(uint8_t outputs, const char *fmt, ...)
+{
+    char line[CONSOLE_PRINTF_LINE];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    console_write_to(outputs, line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+}
+
+/**
+ * @brief Waits until the queued output left the devices, before the kernel stops.
+ */
+void console_sync(void)
+{
+    uart_sync();
+}
\ No newline at end of file
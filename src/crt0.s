@@ -7,11 +7,21 @@
 	.equ .L_MULTIBOOT_TAG_TYPE,  0x0
 	.equ .L_MULTIBOOT_TAG_FLAGS,  0x0
 	.equ .L_MULTIBOOT_TAG_SIZE, 8
+	.equ .L_MULTIBOOT_FRAMEBUFFER_TAG_TYPE, 0x5
+	.equ .L_MULTIBOOT_FRAMEBUFFER_TAG_FLAGS, 0x1 # optional, VGA text mode is kept when there is none
+	.equ .L_MULTIBOOT_FRAMEBUFFER_TAG_SIZE, 20
 
     .long .L_MULTIBOOT_MAGIC
     .long .L_MULTIBOOT_ARCH
     .long .L_MULTIBOOT_HEADER_LENGTH
     .long .L_MULTIBOOT_CHECKSUM
+    .short .L_MULTIBOOT_FRAMEBUFFER_TAG_TYPE
+    .short .L_MULTIBOOT_FRAMEBUFFER_TAG_FLAGS
+    .long .L_MULTIBOOT_FRAMEBUFFER_TAG_SIZE
+    .long 1024 # width
+    .long 768 # height
+    .long 32 # depth
+    .align 8 # tags are 8 bytes aligned
     .short .L_MULTIBOOT_TAG_TYPE
     .short .L_MULTIBOOT_TAG_FLAGS
     .long .L_MULTIBOOT_TAG_SIZE
@@ -25,6 +35,8 @@
 .type _start, @function
 _start:
 	movl $_boot_stack_top, %esp
+	pushl %ebx # multiboot2 information structure
+	pushl %eax # multiboot2 bootloader magic
 	call kernel_main
 	cli
 	hlt
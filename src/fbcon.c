@@ -0,0 +1,207 @@
+#include "fbcon.h"
+#include "font.h"
+#include "multiboot.h"
+#include "mmu.h"
+#include "buddy.h"
+#include "lib.h"
+
+#define FG_COLOR 0xC0C0C0 // RGB
+#define BG_COLOR 0x000000
+
+/*
+ * Characters are drawn in a copy of the screen kept in RAM, one block per text row so that scrolling only
+ * reorders the blocks. The rows drawn into since the last write are then copied to the write combined
+ * framebuffer line by line with memcpy, which uses its widest variant for such sizes.
+ */
+static uint8_t *framebuffer = NULL;
+static uint32_t pitch;
+static uint32_t width;
+static uint32_t cols;
+static uint32_t rows;
+static uint32_t *lines[FBCON_MAX_ROWS]; // FONT_HEIGHT * width pixels each, in screen order
+static uint8_t dirty[FBCON_MAX_ROWS];
+static uint8_t line_order;
+static uint32_t cursor_col = 0;
+static uint32_t cursor_row = 0;
+
+static uint32_t fg;
+static uint32_t bg;
+static uint32_t glyph_masks[256][FONT_WIDTH]; // a row of a glyph as one mask per pixel, all ones where it is set
+
+static uint32_t rgb_color(const multiboot_tag_framebuffer_t *tag, uint32_t rgb)
+{
+    uint32_t r = (rgb >> 16) & 0xFF;
+    uint32_t g = (rgb >> 8) & 0xFF;
+    uint32_t b = rgb & 0xFF;
+    return (r >> (8 - tag->red_size)) << tag->red_position |
+           (g >> (8 - tag->green_size)) << tag->green_position |
+           (b >> (8 - tag->blue_size)) << tag->blue_position;
+}
+
+static void clear_line(uint32_t *line)
+{
+    for (uint32_t i = 0; i < FONT_HEIGHT * width; i++)
+    {
+        line[i] = bg;
+    }
+}
+
+/**
+ * @brief Takes over the screen when the bootloader set a 32 bits RGB framebuffer, mapping it write combined.
+ * @return 0 on success, -1 when the screen stays in VGA text mode.
+ */
+int init_fbcon(void)
+{
+    multiboot_tag_framebuffer_t *tag = (multiboot_tag_framebuffer_t *)multiboot_find_tag(MULTIBOOT_TAG_TYPE_FRAMEBUFFER);
+    if (tag == NULL || tag->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB || tag->bpp != 32 || tag->addr >> 32)
+    {
+        return -1;
+    }
+
+    pitch = tag->pitch;
+    width = tag->width;
+    cols = width / FONT_WIDTH;
+    rows = tag->height / FONT_HEIGHT;
+    if (rows > FBCON_MAX_ROWS)
+    {
+        rows = FBCON_MAX_ROWS;
+    }
+    fg = rgb_color(tag, FG_COLOR);
+    bg = rgb_color(tag, BG_COLOR);
+
+    line_order = 0;
+    while (((uint32_t)PAGE_SIZE << line_order) < FONT_HEIGHT * width * sizeof(uint32_t))
+    {
+        line_order++;
+    }
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        uint32_t page = alloc_pages(line_order);
+        if (page == 0)
+        {
+            while (row-- > 0)
+            {
+                free_pages(virt_to_phys(lines[row]), line_order);
+            }
+            return -1;
+        }
+        lines[row] = phys_to_virt(page);
+        clear_line(lines[row]);
+        dirty[row] = 1;
+    }
+
+    framebuffer = ioremap((uint32_t)tag->addr, pitch * tag->height, MEM_WC);
+    if (framebuffer == NULL)
+    {
+        for (uint32_t row = 0; row < rows; row++)
+        {
+            free_pages(virt_to_phys(lines[row]), line_order);
+        }
+        return -1;
+    }
+
+    for (uint32_t bits = 0; bits < 256; bits++)
+    {
+        for (uint32_t x = 0; x < FONT_WIDTH; x++)
+        {
+            glyph_masks[bits][x] = bits & (0x80 >> x) ? 0xFFFFFFFF : 0;
+        }
+    }
+
+    printf("fbcon: %dx%d, %dx%d characters\n", width, tag->height, cols, rows);
+    return 0;
+}
+
+uint8_t fbcon_active(void)
+{
+    return framebuffer != NULL;
+}
+
+static void draw_glyph(char c, uint32_t col, uint32_t row)
+{
+    const uint8_t *glyph = font_glyphs[(uint8_t)c % FONT_GLYPHS];
+    uint32_t *pixels = lines[row] + col * FONT_WIDTH;
+    for (uint32_t y = 0; y < FONT_HEIGHT; y++)
+    {
+        const uint32_t *mask = glyph_masks[glyph[y]];
+        for (uint32_t x = 0; x < FONT_WIDTH; x++)
+        {
+            pixels[x] = (fg & mask[x]) | (bg & ~mask[x]);
+        }
+        pixels += width;
+    }
+    dirty[row] = 1;
+}
+
+/**
+ * @brief Moves the first row to the bottom, cleared, every row has then moved on the screen.
+ */
+static void scroll_row(void)
+{
+    uint32_t *first = lines[0];
+    memmove(lines, lines + 1, (rows - 1) * sizeof(uint32_t *));
+    lines[rows - 1] = first;
+    clear_line(first);
+    memset(dirty, 1, rows);
+}
+
+static void emit(char c)
+{
+    switch (c)
+    {
+    case '\n':
+        cursor_col = cols - 1;
+        break;
+
+    case '\b':
+        if (cursor_col > 0)
+        {
+            cursor_col--;
+            draw_glyph(' ', cursor_col, cursor_row);
+        }
+        return;
+
+    default:
+        draw_glyph(c, cursor_col, cursor_row);
+        break;
+    }
+
+    if (++cursor_col == cols)
+    {
+        cursor_col = 0;
+        if (++cursor_row == rows)
+        {
+            scroll_row();
+            cursor_row = rows - 1;
+        }
+    }
+}
+
+static void flush(void)
+{
+    for (uint32_t row = 0; row < rows; row++)
+    {
+        if (!dirty[row])
+        {
+            continue;
+        }
+        for (uint32_t y = 0; y < FONT_HEIGHT; y++)
+        {
+            memcpy(framebuffer + (row * FONT_HEIGHT + y) * pitch, lines[row] + y * width, width * sizeof(uint32_t));
+        }
+        dirty[row] = 0;
+    }
+}
+
+/**
+ * @brief Draws len characters in the shadow then copies the rows they changed to the framebuffer,
+ * a batch that scrolls copies the whole screen once however many lines it scrolled.
+ */
+void fbcon_write(const char *buffer, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        emit(buffer[i]);
+    }
+    flush();
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include "idle.h"
+#include "buddy.h"
+#include "klog.h"
+#include "cpu.h"
+#include "monitor.h"
+#include "softirq.h"
+
+static void idle_work(void)
+{
+    do_softirq(); // what the interrupt exits left over
+    zero_pool_refill();
+    klog_flush();
+    monitor_poll();
+}
+
+/**
+ * @brief Runs the background work with interrupts enabled, then waits for the next interrupt.
+ */
+void idle_once(void)
+{
+    __asm__ volatile("sti");
+    idle_work();
+    __asm__ volatile("hlt");
+}
+
+/**
+ * @brief Idles until the queue has seen more events than seen, read by the caller before it checked its condition.
+ */
+void wait_event(wait_queue_t *queue, uint32_t seen)
+{
+    uint32_t flags = irq_save();
+    while (wait_queue_events(queue) == seen)
+    {
+        __asm__ volatile("sti");
+        idle_work();
+        __asm__ volatile("cli");
+        if (wait_queue_events(queue) == seen)
+        {
+            // sti holds the interrupts until after hlt, a wake up right after the check still ends the hlt
+            __asm__ volatile("sti\n hlt\n cli");
+        }
+    }
+    irq_restore(flags);
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "irqstats.h"
+#include "console.h"
+#include "cpu.h"
+#include "lib.h"
+
+#define IRQ_STATS_VECTORS 256
+
+#ifdef IRQ_STATS
+#define IRQ_STATS_BUILT 1
+#else
+#define IRQ_STATS_BUILT 0 // the stubs never call irq_stats_record
+#endif
+
+static const char *stat_names[NB_IRQ_STATS] = {
+    [IRQ_STAT_ENTRY] = "entry",
+    [IRQ_STAT_HANDLER] = "handler",
+    [IRQ_STAT_EXIT] = "exit",
+};
+
+// filled by the interrupt stubs with the interrupts disabled
+static irq_stats_t irq_stats[IRQ_STATS_VECTORS];
+
+static uint32_t log2_bucket(uint32_t cycles)
+{
+    return cycles == 0 ? 0 : 31 - __builtin_clz(cycles);
+}
+
+/**
+ * @brief Adds an interrupt to the histograms of its vector, called by isr_return before iret.
+ */
+void irq_stats_record(uint32_t vector, uint32_t entry, uint32_t handler, uint32_t exit)
+{
+    irq_stats_t *stats = &irq_stats[vector % IRQ_STATS_VECTORS];
+    uint32_t cycles[NB_IRQ_STATS] = {
+        [IRQ_STAT_ENTRY] = entry,
+        [IRQ_STAT_HANDLER] = handler,
+        [IRQ_STAT_EXIT] = exit,
+    };
+
+    stats->count++;
+    for (irq_stat_t stat = 0; stat < NB_IRQ_STATS; stat++)
+    {
+        stats->buckets[stat][log2_bucket(cycles[stat])]++;
+        if (cycles[stat] > stats->max[stat])
+        {
+            stats->max[stat] = cycles[stat];
+        }
+    }
+}
+
+/**
+ * @brief Copies the histograms of a vector.
+ * @return 0, -1 when the kernel is built without IRQ_STATS or the vector does not exist.
+ */
+int irq_stats_get(uint32_t vector, irq_stats_t *stats)
+{
+    if (!IRQ_STATS_BUILT || vector >= IRQ_STATS_VECTORS)
+    {
+        return -1;
+    }
+    uint32_t flags = irq_save();
+    memcpy(stats, &irq_stats[vector], sizeof(irq_stats_t));
+    irq_restore(flags);
+    return 0;
+}
+
+void irq_stats_reset(void)
+{
+    uint32_t flags = irq_save();
+    memset(irq_stats, 0, sizeof(irq_stats));
+    irq_restore(flags);
+}
+
+/**
+ * @brief Writes the histograms of every vector seen on the serial line, one line per step with its
+ * non-empty buckets as log2(cycles):count.
+ */
+void irq_stats_dump(void)
+{
+    if (!IRQ_STATS_BUILT)
+    {
+        console_printf(CONSOLE_SERIAL, "irqstats: not built in, make IRQ_STATS=1\n");
+        return;
+    }
+
+    for (uint32_t vector = 0; vector < IRQ_STATS_VECTORS; vector++)
+    {
+        irq_stats_t stats;
+        irq_stats_get(vector, &stats);
+        if (stats.count == 0)
+        {
+            continue;
+        }
+
+        console_printf(CONSOLE_SERIAL, "vector 0x%02x: %u interrupts\n", vector, stats.count);
+        for (irq_stat_t stat = 0; stat < NB_IRQ_STATS; stat++)
+        {
+            console_printf(CONSOLE_SERIAL, "  %-8s max %u", stat_names[stat], stats.max[stat]);
+            for (uint32_t bucket = 0; bucket < IRQ_STATS_BUCKETS; bucket++)
+            {
+                if (stats.buckets[stat][bucket] != 0)
+                {
+                    console_printf(CONSOLE_SERIAL, " %u:%u", bucket, stats.buckets[stat][bucket]);
+                }
+            }
+            console_printf(CONSOLE_SERIAL, "\n");
+        }
+    }
+}
\ No newline at end of file
@@ -1,308 +1,178 @@
-extern global_fault_handler
-extern global_irq_handler
-extern global_int_handler
+extern interrupt_handlers
+extern lapic_eoi
+extern softirq_pending
+extern do_softirq
+%ifdef IRQ_STATS
+extern irq_stats_record
+%endif
 
-%macro FAULT_HANDLER_ERR_CODE 1
-global fault_handler_%1
-fault_handler_%1:
-    cli
-    push %1
-    mov ecx, global_fault_handler
-    jmp isr_handler
-%endmacro
+KERNEL_DATA_SELECTOR equ 0x10
+IRQ_BASE equ 0x20           ; the master PIC, the slave comes right after
+IRQ_SLAVE_BASE equ 0x28
+FIRST_INT_VECTOR equ 0x30
+PIC_MASTER_COMMAND equ 0x20
+PIC_SLAVE_COMMAND equ 0xA0
+PIC_EOI equ 0x20
 
-%macro HANDLER 2
-global %1_handler_%2
-%1_handler_%2:
-    cli
-    push 0
-    push %2
-    mov ecx, global_%1_handler
-    jmp isr_handler
-%endmacro
+; offsets in struct regs
+REGS_PUSHA equ 16
+REGS_INT_NO equ 48
+REGS_CS equ 60
 
-%macro FAULT_HANDLER_NO_ERR_CODE 1
-HANDLER fault, %1
+; the CPU pushes an error code for these vectors, the stubs of the others push a 0 in its place
+%define HAS_ERROR_CODE(v) ((v) == 8 || ((v) >= 10 && (v) <= 14) || (v) == 17 || (v) == 21 || (v) == 29 || (v) == 30)
+
+; the segments are always saved to keep struct regs whole, but only reloaded when coming from ring 3
+%macro SAVE_REGS 0
+    pusha
+%ifdef IRQ_STATS
+    rdtsc
+    mov esi, eax   ; stub entry, esi, edi and ebx are kept by the handler
+%endif
+    push ds
+    push es
+    push fs
+    push gs
+    test byte [esp + REGS_CS], 3
+    jz %%from_kernel
+    mov ax, KERNEL_DATA_SELECTOR
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+%%from_kernel:
 %endmacro
 
-%macro IRQ_HANDLER 1
-HANDLER irq, %1
+; calls the handler of the vector straight from interrupt_handlers, with the registers as argument
+%macro CALL_HANDLER 0
+%ifdef IRQ_STATS
+    rdtsc
+    mov edi, eax   ; handler entry
+%endif
+    mov eax, [esp + REGS_INT_NO]
+    push esp
+    call [interrupt_handlers + eax * 4]
+    add esp, 4
+%ifdef IRQ_STATS
+    rdtsc
+    mov ebx, eax   ; handler exit, the end of interrupt comes next
+%endif
 %endmacro
 
-%macro INT_HANDLER 1
-HANDLER int, %1
+; gives the cycles of the three steps to irq_stats_record, esp is on the pusha frame
+%macro RECORD_STATS 0
+    rdtsc
+    sub eax, ebx
+    push eax       ; end of interrupt to iret
+    sub ebx, edi
+    push ebx       ; handler
+    sub edi, esi
+    push edi       ; stub entry to handler entry
+    push dword [esp + 12 + REGS_INT_NO - REGS_PUSHA]
+    call irq_stats_record
+    add esp, 16
 %endmacro
 
-isr_handler:
+isr_common:
+    SAVE_REGS
+    CALL_HANDLER
+    jmp isr_return
+
+irq_common:
+    SAVE_REGS
+    CALL_HANDLER
+    mov eax, [lapic_eoi]
+    test eax, eax
+    jz .pic
+    mov dword [eax], 0 ; one uncached store to the local APIC
+    jmp .softirq
+.pic:
+    mov al, PIC_EOI
+    cmp dword [esp + REGS_INT_NO], IRQ_SLAVE_BASE
+    jb .master
+    out PIC_SLAVE_COMMAND, al
+.master:
+    out PIC_MASTER_COMMAND, al
+.softirq:
+    cmp dword [softirq_pending], 0 ; the boot CPU's
+    je isr_return
+    call do_softirq    ; the bottom halves, with the interrupts enabled
+
+isr_return:
+    test byte [esp + REGS_CS], 3
+    jz .to_kernel
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    jmp .restore
+.to_kernel:
+    add esp, 16    ; the kernel segments were never changed
+.restore:
+%ifdef IRQ_STATS
+    RECORD_STATS
+%endif
+    popa
+    add esp, 8     ; Cleans up the pushed error code and pushed ISR number
+    iret           ; pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP!
+
+; one stub per vector, the IRQs send the end of interrupt after their handler
+%assign vector 0
+%rep 256
+isr_%+vector:
+    cli
+%if !HAS_ERROR_CODE(vector)
+    push 0
+%endif
+    push vector
+%if vector >= IRQ_BASE && vector < FIRST_INT_VECTOR
+    jmp irq_common
+%else
+    jmp isr_common
+%endif
+%assign vector vector + 1
+%endrep
+
+; the addresses of the stubs, init_idt makes the gates from them
+section .rodata
+global isr_stubs
+isr_stubs:
+%assign vector 0
+%rep 256
+    dd isr_%+vector
+%assign vector vector + 1
+%endrep
+
+%ifdef BENCH
+; the dispatch every interrupt went through before the per-vector stubs, kept to measure them against:
+; segments always reloaded, then a C function mapping the vector to its handler
+extern bench_legacy_dispatch
+
+section .text
+global isr_legacy_stub
+isr_legacy_stub:
+    cli
+    push 0
+    push 0xF1      ; BENCH_LEGACY_VECTOR
+    mov ecx, bench_legacy_dispatch
     pusha
     push ds
     push es
     push fs
     push gs
-    mov ax, 0x10   ; Load the Kernel Data Segment descriptor
+    mov ax, KERNEL_DATA_SELECTOR
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    push esp       ; Push the stack pointer
-    call ecx       ; A special call, preserves the 'eip' register
+    push esp
+    call ecx
     pop eax
     pop gs
     pop fs
     pop es
     pop ds
     popa
-    add esp, 8     ; Cleans up the pushed error code and pushed ISR number
-    iret           ; pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP!
-
-FAULT_HANDLER_NO_ERR_CODE 0x0
-FAULT_HANDLER_NO_ERR_CODE 0x1
-FAULT_HANDLER_NO_ERR_CODE 0x2
-FAULT_HANDLER_NO_ERR_CODE 0x3
-FAULT_HANDLER_NO_ERR_CODE 0x4
-FAULT_HANDLER_NO_ERR_CODE 0x5
-FAULT_HANDLER_NO_ERR_CODE 0x6
-FAULT_HANDLER_NO_ERR_CODE 0x7
-FAULT_HANDLER_NO_ERR_CODE 0x8 ; err code already pushed
-FAULT_HANDLER_NO_ERR_CODE 0x9
-FAULT_HANDLER_ERR_CODE 0xA
-FAULT_HANDLER_ERR_CODE 0xB
-FAULT_HANDLER_ERR_CODE 0xC
-FAULT_HANDLER_ERR_CODE 0xD
-FAULT_HANDLER_ERR_CODE 0xE
-FAULT_HANDLER_NO_ERR_CODE 0xF
-FAULT_HANDLER_NO_ERR_CODE 0x10
-FAULT_HANDLER_ERR_CODE 0x11
-FAULT_HANDLER_NO_ERR_CODE 0x12
-FAULT_HANDLER_NO_ERR_CODE 0x13
-FAULT_HANDLER_NO_ERR_CODE 0x14
-FAULT_HANDLER_NO_ERR_CODE 0x15
-FAULT_HANDLER_NO_ERR_CODE 0x1C
-FAULT_HANDLER_ERR_CODE 0x1D
-FAULT_HANDLER_ERR_CODE 0x1E
-
-IRQ_HANDLER 0x20
-IRQ_HANDLER 0x21
-IRQ_HANDLER 0x22
-IRQ_HANDLER 0x23
-IRQ_HANDLER 0x24
-IRQ_HANDLER 0x25
-IRQ_HANDLER 0x26
-IRQ_HANDLER 0x27
-IRQ_HANDLER 0x70
-IRQ_HANDLER 0x71
-IRQ_HANDLER 0x72
-IRQ_HANDLER 0x73
-IRQ_HANDLER 0x74
-IRQ_HANDLER 0x75
-IRQ_HANDLER 0x76
-IRQ_HANDLER 0x77
-
-INT_HANDLER 0x28
-INT_HANDLER 0x29
-INT_HANDLER 0x2A
-INT_HANDLER 0x2B
-INT_HANDLER 0x2C
-INT_HANDLER 0x2D
-INT_HANDLER 0x2E
-INT_HANDLER 0x2F
-INT_HANDLER 0x30
-INT_HANDLER 0x31
-INT_HANDLER 0x32
-INT_HANDLER 0x33
-INT_HANDLER 0x34
-INT_HANDLER 0x35
-INT_HANDLER 0x36
-INT_HANDLER 0x37
-INT_HANDLER 0x38
-INT_HANDLER 0x39
-INT_HANDLER 0x3A
-INT_HANDLER 0x3B
-INT_HANDLER 0x3C
-INT_HANDLER 0x3D
-INT_HANDLER 0x3E
-INT_HANDLER 0x3F
-INT_HANDLER 0x40
-INT_HANDLER 0x41
-INT_HANDLER 0x42
-INT_HANDLER 0x43
-INT_HANDLER 0x44
-INT_HANDLER 0x45
-INT_HANDLER 0x46
-INT_HANDLER 0x47
-INT_HANDLER 0x48
-INT_HANDLER 0x49
-INT_HANDLER 0x4A
-INT_HANDLER 0x4B
-INT_HANDLER 0x4C
-INT_HANDLER 0x4D
-INT_HANDLER 0x4E
-INT_HANDLER 0x4F
-INT_HANDLER 0x50
-INT_HANDLER 0x51
-INT_HANDLER 0x52
-INT_HANDLER 0x53
-INT_HANDLER 0x54
-INT_HANDLER 0x55
-INT_HANDLER 0x56
-INT_HANDLER 0x57
-INT_HANDLER 0x58
-INT_HANDLER 0x59
-INT_HANDLER 0x5A
-INT_HANDLER 0x5B
-INT_HANDLER 0x5C
-INT_HANDLER 0x5D
-INT_HANDLER 0x5E
-INT_HANDLER 0x5F
-INT_HANDLER 0x60
-INT_HANDLER 0x61
-INT_HANDLER 0x62
-INT_HANDLER 0x63
-INT_HANDLER 0x64
-INT_HANDLER 0x65
-INT_HANDLER 0x66
-INT_HANDLER 0x67
-INT_HANDLER 0x68
-INT_HANDLER 0x69
-INT_HANDLER 0x6A
-INT_HANDLER 0x6B
-INT_HANDLER 0x6C
-INT_HANDLER 0x6D
-INT_HANDLER 0x6E
-INT_HANDLER 0x6F
-INT_HANDLER 0x78
-INT_HANDLER 0x79
-INT_HANDLER 0x7A
-INT_HANDLER 0x7B
-INT_HANDLER 0x7C
-INT_HANDLER 0x7D
-INT_HANDLER 0x7E
-INT_HANDLER 0x7F
-INT_HANDLER 0x80
-INT_HANDLER 0x81
-INT_HANDLER 0x82
-INT_HANDLER 0x83
-INT_HANDLER 0x84
-INT_HANDLER 0x85
-INT_HANDLER 0x86
-INT_HANDLER 0x87
-INT_HANDLER 0x88
-INT_HANDLER 0x89
-INT_HANDLER 0x8A
-INT_HANDLER 0x8B
-INT_HANDLER 0x8C
-INT_HANDLER 0x8D
-INT_HANDLER 0x8E
-INT_HANDLER 0x8F
-INT_HANDLER 0x90
-INT_HANDLER 0x91
-INT_HANDLER 0x92
-INT_HANDLER 0x93
-INT_HANDLER 0x94
-INT_HANDLER 0x95
-INT_HANDLER 0x96
-INT_HANDLER 0x97
-INT_HANDLER 0x98
-INT_HANDLER 0x99
-INT_HANDLER 0x9A
-INT_HANDLER 0x9B
-INT_HANDLER 0x9C
-INT_HANDLER 0x9D
-INT_HANDLER 0x9E
-INT_HANDLER 0x9F
-INT_HANDLER 0xA0
-INT_HANDLER 0xA1
-INT_HANDLER 0xA2
-INT_HANDLER 0xA3
-INT_HANDLER 0xA4
-INT_HANDLER 0xA5
-INT_HANDLER 0xA6
-INT_HANDLER 0xA7
-INT_HANDLER 0xA8
-INT_HANDLER 0xA9
-INT_HANDLER 0xAA
-INT_HANDLER 0xAB
-INT_HANDLER 0xAC
-INT_HANDLER 0xAD
-INT_HANDLER 0xAE
-INT_HANDLER 0xAF
-INT_HANDLER 0xB0
-INT_HANDLER 0xB1
-INT_HANDLER 0xB2
-INT_HANDLER 0xB3
-INT_HANDLER 0xB4
-INT_HANDLER 0xB5
-INT_HANDLER 0xB6
-INT_HANDLER 0xB7
-INT_HANDLER 0xB8
-INT_HANDLER 0xB9
-INT_HANDLER 0xBA
-INT_HANDLER 0xBB
-INT_HANDLER 0xBC
-INT_HANDLER 0xBD
-INT_HANDLER 0xBE
-INT_HANDLER 0xBF
-INT_HANDLER 0xC0
-INT_HANDLER 0xC1
-INT_HANDLER 0xC2
-INT_HANDLER 0xC3
-INT_HANDLER 0xC4
-INT_HANDLER 0xC5
-INT_HANDLER 0xC6
-INT_HANDLER 0xC7
-INT_HANDLER 0xC8
-INT_HANDLER 0xC9
-INT_HANDLER 0xCA
-INT_HANDLER 0xCB
-INT_HANDLER 0xCC
-INT_HANDLER 0xCD
-INT_HANDLER 0xCE
-INT_HANDLER 0xCF
-INT_HANDLER 0xD0
-INT_HANDLER 0xD1
-INT_HANDLER 0xD2
-INT_HANDLER 0xD3
-INT_HANDLER 0xD4
-INT_HANDLER 0xD5
-INT_HANDLER 0xD6
-INT_HANDLER 0xD7
-INT_HANDLER 0xD8
-INT_HANDLER 0xD9
-INT_HANDLER 0xDA
-INT_HANDLER 0xDB
-INT_HANDLER 0xDC
-INT_HANDLER 0xDD
-INT_HANDLER 0xDE
-INT_HANDLER 0xDF
-INT_HANDLER 0xE0
-INT_HANDLER 0xE1
-INT_HANDLER 0xE2
-INT_HANDLER 0xE3
-INT_HANDLER 0xE4
-INT_HANDLER 0xE5
-INT_HANDLER 0xE6
-INT_HANDLER 0xE7
-INT_HANDLER 0xE8
-INT_HANDLER 0xE9
-INT_HANDLER 0xEA
-INT_HANDLER 0xEB
-INT_HANDLER 0xEC
-INT_HANDLER 0xED
-INT_HANDLER 0xEE
-INT_HANDLER 0xEF
-INT_HANDLER 0xF0
-INT_HANDLER 0xF1
-INT_HANDLER 0xF2
-INT_HANDLER 0xF3
-INT_HANDLER 0xF4
-INT_HANDLER 0xF5
-INT_HANDLER 0xF6
-INT_HANDLER 0xF7
-INT_HANDLER 0xF8
-INT_HANDLER 0xF9
-INT_HANDLER 0xFA
-INT_HANDLER 0xFB
-INT_HANDLER 0xFC
-INT_HANDLER 0xFD
-INT_HANDLER 0xFE
-INT_HANDLER 0xFF
+    add esp, 8
+    iret
+%endif
\ No newline at end of file
@@ -1,186 +1,302 @@
 #include "keyboard.h"
+#include "keymap.h"
 #include "screen.h"
 #include "ioport.h"
+#include "console.h"
+#include "cmdline.h"
+#include "idle.h"
+#include "lib.h"
+#include "klog.h"
+#include "softirq.h"
 
-#define BUFFER_SIZE 128
+#define KEYBOARD_RING 256     // key events not read yet, a power of 2
+#define KEYBOARD_SCANCODES 64 // scancodes waiting for the tasklet, a power of 2
+#define KEYBOARD_LINE 256
+#define KEYMAP_NAME 16
 
-#define SHIFT_PRESSED 0x2A
-#define SHIFT_RELEASED 0xAA
-#define RIGHT_SHIFT_PRESSED 0x36
-#define RIGHT_SHIFT_RELEASED 0xB6
-#define CTRL_PRESSED 0x1D
-#define CTRL_RELEASED 0x9D
-#define ALT_PRESSED 0x38
-#define ALT_RELEASED 0xB8
+#define SCANCODE_EXTENDED 0xE0
+#define SCANCODE_PAUSE 0xE1 // followed by 1D 45 E1 9D C5, the key has no release
+#define PAUSE_LENGTH 5
 
-#define SET_KEY(code, key) key_map[code] = key;
-#define SET_EVENT_KEY(code, key)
+#define KEY_CAPS_LOCK 0x3A
+#define KEY_FAKE_LEFT_SHIFT (KEY_EXTENDED | 0x2A) // sent around some extended keys, when num lock is on
+#define KEY_FAKE_RIGHT_SHIFT (KEY_EXTENDED | 0x36)
+#define KEY_PAGE_UP (KEY_EXTENDED | 0x49)
+#define KEY_PAGE_DOWN (KEY_EXTENDED | 0x51)
 
-unsigned char key_map[256];
+typedef enum
+{
+    DECODE_SCANCODE,
+    DECODE_EXTENDED, // after E0
+    DECODE_PAUSE,    // skipping the rest of the pause sequence
+} decode_state_t;
+
+static const uint8_t modifier_keys[NB_KEY_CODES] = {
+    [0x2A] = KEY_MOD_SHIFT,
+    [0x36] = KEY_MOD_SHIFT,
+    [0x1D] = KEY_MOD_CTRL,
+    [KEY_EXTENDED | 0x1D] = KEY_MOD_CTRL,
+    [0x38] = KEY_MOD_ALT,
+    [KEY_EXTENDED | 0x38] = KEY_MOD_ALTGR,
+};
+
+static const keymap_t *keymap = &keymaps[0];
+static decode_state_t decode_state = DECODE_SCANCODE;
+static uint8_t pause_left = 0;
+static uint8_t modifiers = 0;
+
+// single producer, the IRQ handler, and single consumer, the reader
+static key_event_t ring[KEYBOARD_RING];
+static uint32_t ring_head = 0; // only written by the IRQ handler
+static uint32_t ring_tail = 0; // only written by the reader
+static wait_queue_t keyboard_wait;
+
+// single producer, the IRQ handler, and single consumer, the tasklet
+static uint8_t scancodes[KEYBOARD_SCANCODES];
+static uint32_t scancode_head = 0;
+static uint32_t scancode_tail = 0;
 
-char shift_pressed = 0;
-char alt_pressed = 0;
-char ctrl_pressed = 0;
-char global_c = 0;
+static void keyboard_tasklet_run(uint32_t unused);
+static tasklet_t keyboard_tasklet = TASKLET_INIT(keyboard_tasklet_run, 0);
 
-char handler = -1;
-unsigned char keyboard_buffer[BUFFER_SIZE];
+// line being edited by keyboard_read
+static char line[KEYBOARD_LINE];
+static uint32_t line_len = 0;
+static uint32_t line_pos = 0; // characters of a finished line already read
+static uint8_t line_done = 0;
 
-void init_key_map()
+/**
+ * @brief Picks the keymap named by the keymap= option of the command line, the first one by default.
+ */
+void init_keyboard(void)
 {
-    for (int i = 0; i < 256; i++)
-    {
-        SET_KEY(i, '\0')
-    }
-
-    SET_KEY(0x02, '&')
-    SET_KEY(0x04, '"')
-    SET_KEY(0x05, '\'')
-    SET_KEY(0x06, '(')
-    SET_KEY(0x07, '-')
-    SET_KEY(0x09, '_')
-    SET_KEY(0x0C, ')')
-    SET_KEY(0x0D, '=')
-
-    SET_KEY(0x10, 'a')
-    SET_KEY(0x11, 'z')
-    SET_KEY(0x12, 'e')
-    SET_KEY(0x13, 'r')
-    SET_KEY(0x14, 't')
-    SET_KEY(0x15, 'y')
-    SET_KEY(0x16, 'u')
-    SET_KEY(0x17, 'i')
-    SET_KEY(0x18, 'o')
-    SET_KEY(0x19, 'p')
-    SET_KEY(0x1E, 'q')
-    SET_KEY(0x1F, 's')
-    SET_KEY(0x20, 'd')
-    SET_KEY(0x21, 'f')
-    SET_KEY(0x22, 'g')
-    SET_KEY(0x23, 'h')
-    SET_KEY(0x24, 'j')
-    SET_KEY(0x25, 'k')
-    SET_KEY(0x26, 'l')
-    SET_KEY(0x27, 'm')
-    SET_KEY(0x2C, 'w')
-    SET_KEY(0x2D, 'x')
-    SET_KEY(0x2E, 'c')
-    SET_KEY(0x2F, 'v')
-    SET_KEY(0x30, 'b')
-    SET_KEY(0x31, 'n')
-
-    SET_KEY(0x32, ',')
-    SET_KEY(0x33, ';')
-    SET_KEY(0x34, ':')
-    SET_KEY(0x35, '!')
-    SET_KEY(0x39, ' ')
-    SET_KEY(0xE, '\b')
-    SET_KEY(0x1C, '\n')
-
-    SET_KEY(0xB, '0')
-    SET_KEY(0x2, '1')
-    SET_KEY(0x3, '2')
-    SET_KEY(0x4, '3')
-    SET_KEY(0x5, '4')
-    SET_KEY(0x6, '5')
-    SET_KEY(0x7, '6')
-    SET_KEY(0x8, '7')
-    SET_KEY(0x9, '8')
-    SET_KEY(0xA, '9')
+    char name[KEYMAP_NAME];
+    if (cmdline_get("keymap", name, sizeof(name)) < 0)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < nb_keymaps; i++)
+    {
+        if (strcmp(keymaps[i].name, name) == 0)
+        {
+            keymap = &keymaps[i];
+            return;
+        }
+    }
+    printf("keyboard: unknown keymap %s, %s is used\n", name, keymap->name);
 }
 
-char get_char_from_code(unsigned char code)
+static char translate(uint8_t code)
 {
-    if (code == ALT_PRESSED)
+    if (modifiers & KEY_MOD_CTRL)
     {
-        alt_pressed = 1;
         return 0;
     }
-    else if (code == ALT_RELEASED)
+    if (modifiers & KEY_MOD_ALTGR)
     {
-        alt_pressed = 0;
-        return 0;
+        return keymap->altgr[code];
     }
-    else if (code == SHIFT_PRESSED)
+
+    char c = keymap->normal[code];
+    uint8_t shifted = (modifiers & KEY_MOD_SHIFT) != 0;
+    if (c >= 'a' && c <= 'z' && (modifiers & KEY_MOD_CAPS_LOCK))
+    {
+        shifted = !shifted;
+    }
+    return shifted ? keymap->shifted[code] : c;
+}
+
+/**
+ * @brief Feeds a scancode of set 1 to the decoder.
+ * @return 1 when it completes a key event, 0 for the prefixes.
+ */
+static uint8_t decode(uint8_t scancode, key_event_t *event)
+{
+    if (decode_state == DECODE_PAUSE)
     {
-        shift_pressed = 1;
+        if (--pause_left == 0)
+        {
+            decode_state = DECODE_SCANCODE;
+        }
         return 0;
     }
-    else if (code == SHIFT_RELEASED)
+    if (scancode == SCANCODE_EXTENDED)
     {
-        shift_pressed = 0;
+        decode_state = DECODE_EXTENDED;
         return 0;
     }
-    else if (code == CTRL_PRESSED)
+    if (scancode == SCANCODE_PAUSE)
     {
-        ctrl_pressed = 1;
+        decode_state = DECODE_PAUSE;
+        pause_left = PAUSE_LENGTH;
         return 0;
     }
-    else if (code == CTRL_RELEASED)
+
+    uint8_t code = (scancode & ~KEY_RELEASED) | (decode_state == DECODE_EXTENDED ? KEY_EXTENDED : 0);
+    decode_state = DECODE_SCANCODE;
+    if (code == KEY_FAKE_LEFT_SHIFT || code == KEY_FAKE_RIGHT_SHIFT)
     {
-        ctrl_pressed = 0;
         return 0;
     }
-    else if (key_map[code] >= 'a' && key_map[code] <= 'z')
+
+    event->code = code;
+    event->pressed = !(scancode & KEY_RELEASED);
+    if (modifier_keys[code])
     {
-        if (ctrl_pressed)
-        {
-            if (key_map[code] == 'l')
-            {
-                clear_screen();
-            }
-            ctrl_pressed = 0;
-            return '\0';
-        }
+        modifiers = event->pressed ? modifiers | modifier_keys[code] : modifiers & ~modifier_keys[code];
+    }
+    else if (code == KEY_CAPS_LOCK && event->pressed)
+    {
+        modifiers ^= KEY_MOD_CAPS_LOCK;
+    }
+    event->modifiers = modifiers;
+    event->c = event->pressed ? translate(code) : 0;
+    return 1;
+}
+
+/**
+ * @brief Handles the keys acting on the console itself, which never reach the readers.
+ */
+static uint8_t console_shortcut(const key_event_t *event)
+{
+    if ((event->modifiers & KEY_MOD_SHIFT) && (event->code == KEY_PAGE_UP || event->code == KEY_PAGE_DOWN))
+    {
+        screen_scroll(event->code == KEY_PAGE_UP ? SCREEN_HEIGHT / 2 : -(SCREEN_HEIGHT / 2));
+        return 1;
+    }
+    if ((event->modifiers & KEY_MOD_CTRL) && keymap->normal[event->code] == 'l')
+    {
+        clear_screen();
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Queues a key event for the readers. When the ring is full the new event is dropped, what was typed
+ * before is kept.
+ */
+static void queue_event(const key_event_t *event)
+{
+    uint32_t head = ring_head;
+    if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == KEYBOARD_RING)
+    {
+        klog(KLOG_WARN, "keyboard: input dropped, nobody reads it\n");
+        return;
+    }
+    ring[head % KEYBOARD_RING] = *event;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+    wake_up(&keyboard_wait);
+}
+
+/**
+ * @brief Bottom half: decodes the scancodes into key events with the interrupts enabled, and runs the console
+ * shortcuts. Echo and line editing are left to the reader.
+ */
+static void keyboard_tasklet_run(uint32_t unused)
+{
+    (void)unused;
+    uint32_t tail = scancode_tail;
+    while (tail != __atomic_load_n(&scancode_head, __ATOMIC_ACQUIRE))
+    {
+        uint8_t scancode = scancodes[tail % KEYBOARD_SCANCODES];
+        __atomic_store_n(&scancode_tail, ++tail, __ATOMIC_RELEASE);
 
-        if (shift_pressed)
+        key_event_t event;
+        if (decode(scancode, &event) && !(event.pressed && console_shortcut(&event)))
         {
-            return key_map[code] - 32;
+            queue_event(&event);
         }
-        else
+    }
+}
+
+/**
+ * @brief Top half: takes the scancode off the controller and leaves the rest to the tasklet.
+ */
+void keyboard_handler(void)
+{
+    uint8_t scancode = inb(0x60);
+    uint32_t head = scancode_head;
+    if (head - __atomic_load_n(&scancode_tail, __ATOMIC_ACQUIRE) == KEYBOARD_SCANCODES)
+    {
+        return; // the tasklet is already queued, it has fallen this far behind
+    }
+    scancodes[head % KEYBOARD_SCANCODES] = scancode;
+    __atomic_store_n(&scancode_head, head + 1, __ATOMIC_RELEASE);
+    tasklet_schedule(&keyboard_tasklet);
+}
+
+/**
+ * @brief Takes the oldest key event, presses and releases.
+ * @return 0 when there is none.
+ */
+uint8_t keyboard_poll_event(key_event_t *event)
+{
+    uint32_t tail = ring_tail;
+    if (tail == __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    *event = ring[tail % KEYBOARD_RING];
+    __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * @brief Takes the next character typed, idling until there is one. Events typing nothing are dropped.
+ */
+int keyboard_getc(void)
+{
+    for (;;)
+    {
+        uint32_t seen = wait_queue_events(&keyboard_wait);
+        key_event_t event;
+        while (keyboard_poll_event(&event))
         {
-            return key_map[code];
+            if (event.c != 0)
+            {
+                return (unsigned char)event.c;
+            }
         }
+        wait_event(&keyboard_wait, seen);
     }
-    return key_map[code];
 }
 
-void keyboard_handler()
+/**
+ * @brief Reads at most size characters of a line, echoing the characters typed and handling backspace
+ * until the line ends with a newline. What does not fit stays for the next read.
+ */
+size_t keyboard_read(char *buffer, size_t size)
 {
-    unsigned char c = inb(0x60);
-    c = get_char_from_code(c);
-    if (c != 0)
+    while (!line_done)
     {
-        static int cursor = 0;
-        if (cursor >= BUFFER_SIZE)
+        char c = keyboard_getc();
+        if (c == '\b')
+        {
+            if (line_len > 0)
+            {
+                line_len--;
+                console_write(&c, 1);
+            }
+            continue;
+        }
+        if (line_len == KEYBOARD_LINE - 1 && c != '\n')
         {
-            cursor = 0;
+            continue;
         }
-        keyboard_buffer[cursor] = c;
-        cursor++;
-        putchar(c);
+        line[line_len++] = c;
+        console_write(&c, 1);
+        line_done = c == '\n';
     }
-}
 
-// unsigned char getc()
-// {
-//     static int cursor = 0;
-//     if (cursor >= BUFFER_SIZE)
-//     {
-//         cursor = 0;
-//     }
-//     unsigned char c = keyboard_buffer[cursor];
-//     keyboard_buffer[cursor % BUFFER_SIZE] = '\0';
-//     cursor++;
-//     return c;
-// }
-
-// void gets(char *buf, int nb_char)
-// {
-//     int i = 0;
-//     while (i < nb_char)
-//     {
-//         buf[i] = getc();
-//         i++;
-//     }
-// }
\ No newline at end of file
+    size_t len = line_len - line_pos < size ? line_len - line_pos : size;
+    memcpy(buffer, line + line_pos, len);
+    line_pos += len;
+    if (line_pos == line_len)
+    {
+        line_len = 0;
+        line_pos = 0;
+        line_done = 0;
+    }
+    return len;
+}
\ No newline at end of file
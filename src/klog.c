@@ -0,0 +1,142 @@
+#include "klog.h"
+#include "lib.h"
+#include "console.h"
+#include "cpu.h"
+
+#define KLOG_LINE 160 // a record once formatted with its header
+
+static klog_record_t records[KLOG_RECORDS];
+static uint32_t klog_head = 0; // sequence number of the next message
+static uint32_t console_seq = 0;
+static klog_level_t console_level = KLOG_INFO;
+static uint8_t console_outputs = CONSOLE_ALL;
+
+static const char *level_names[NB_KLOG_LEVELS] = {
+    [KLOG_ERR] = "err",
+    [KLOG_WARN] = "warn",
+    [KLOG_INFO] = "info",
+    [KLOG_DEBUG] = "debug",
+};
+
+/**
+ * @brief Logs a message without any lock nor output, so it can be called from any interrupt handler:
+ * the producer claims a sequence number with an atomic increment and formats its message straight into the slot.
+ */
+void klog(klog_level_t level, const char *fmt, ...)
+{
+    uint32_t seq = __atomic_fetch_add(&klog_head, 1, __ATOMIC_RELAXED);
+    klog_record_t *record = &records[seq % KLOG_RECORDS];
+
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->level = level;
+    record->timestamp = rdtsc();
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(record->text, KLOG_TEXT, fmt, args);
+    va_end(args);
+    record->len = len < KLOG_TEXT ? len : KLOG_TEXT - 1;
+
+    __atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Copies the record of sequence number seq, returns 0 when it is not written yet,
+ * -1 when it was overwritten and 1 on success. The sequence is checked again after the copy
+ * in case a producer went around the ring meanwhile.
+ */
+static int read_record(uint32_t seq, klog_record_t *copy)
+{
+    klog_record_t *record = &records[seq % KLOG_RECORDS];
+    uint32_t record_seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+    if (record_seq != seq + 1)
+    {
+        return (int32_t)(record_seq - (seq + 1)) > 0 ? -1 : 0;
+    }
+    memcpy(copy, record, sizeof(klog_record_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&record->seq, __ATOMIC_RELAXED) == record_seq ? 1 : -1;
+}
+
+/**
+ * @brief Formats the messages from *seq up to max_level into buffer as "[tsc] level: text" lines,
+ * as many whole lines as fit, and moves *seq past them. Messages already overwritten are skipped,
+ * a line longer than the whole buffer is truncated.
+ */
+size_t klog_read(uint32_t *seq, char *buffer, size_t size, klog_level_t max_level)
+{
+    size_t pos = 0;
+    while (size > 0)
+    {
+        uint32_t head = __atomic_load_n(&klog_head, __ATOMIC_ACQUIRE);
+        if (head - *seq > KLOG_RECORDS)
+        {
+            *seq = head - KLOG_RECORDS;
+        }
+        if (*seq == head)
+        {
+            return pos;
+        }
+
+        klog_record_t record;
+        int res = read_record(*seq, &record);
+        if (res == 0)
+        {
+            return pos;
+        }
+        if (res < 0 || record.level > max_level)
+        {
+            (*seq)++;
+            continue;
+        }
+
+        char line[KLOG_LINE];
+        uint8_t newline = record.len == 0 || record.text[record.len - 1] != '\n';
+        int len = snprintf(line, sizeof(line), "[%llu] %s: %.*s%s", record.timestamp, level_names[record.level],
+                           record.len, record.text, newline ? "\n" : "");
+        if ((size_t)len >= sizeof(line))
+        {
+            len = sizeof(line) - 1;
+        }
+        if (pos + len > size)
+        {
+            if (pos != 0)
+            {
+                return pos;
+            }
+            len = size;
+        }
+        memcpy(buffer + pos, line, len);
+        pos += len;
+        (*seq)++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Writes the messages not printed yet to the console. It runs from the idle loop, far from the interrupt
+ * handlers that log, and on the paths that stop the kernel.
+ */
+void klog_flush(void)
+{
+    char buffer[KLOG_LINE * 2];
+    size_t len;
+    while ((len = klog_read(&console_seq, buffer, sizeof(buffer), console_level)) > 0)
+    {
+        console_write_to(console_outputs, buffer, len);
+    }
+}
+
+void klog_set_console_level(klog_level_t level)
+{
+    console_level = level;
+}
+
+/**
+ * @brief Picks the console devices the log goes to, CONSOLE_SERIAL alone keeps it off the screen.
+ */
+void klog_set_console_outputs(uint8_t outputs)
+{
+    console_outputs = outputs;
+}
\ No newline at end of file
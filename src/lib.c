@@ -1,5 +1,36 @@
 #include "lib.h"
-#include <stdarg.h>
+#include "console.h"
+
+#define PRINTF_BUFFER 256 // printf formats into this much stack and writes it to the console in one go
+
+#define FORMAT_LEFT 1 // '-' flag
+#define FORMAT_ZERO 2 // '0' flag
+#define FORMAT_SIGNED 4
+#define FORMAT_UPPER 8
+
+/**
+ * @brief Where the formatted characters go: buffer holds size bytes, flush empties it when it is full
+ * or drops what does not fit when NULL, len counts every character produced.
+ */
+typedef struct format_out
+{
+    char *buffer;
+    size_t size;
+    size_t pos;
+    size_t len;
+    void (*flush)(struct format_out *out);
+} format_out_t;
+
+typedef struct
+{
+    uint8_t flags;
+    int width;
+    int precision; // -1 when none is given
+    uint8_t base;
+} format_spec_t;
+
+static const char lower_digits[] = "0123456789abcdef";
+static const char upper_digits[] = "0123456789ABCDEF";
 
 void putc(char c)
 {
@@ -8,10 +39,7 @@ void putc(char c)
 
 void puts(const char *str)
 {
-    for (size_t i = 0; i < strlen(str); i++)
-    {
-        putc(str[i]);
-    }
+    console_write(str, strlen(str));
 }
 
 size_t strlen(const char *str)
@@ -24,120 +52,315 @@ size_t strlen(const char *str)
     return len;
 }
 
-void *memset(void *ptr, int value, size_t size)
+int strcmp(const char *s1, const char *s2)
 {
-    unsigned char *p = (unsigned char *)ptr;
-    unsigned char val = (unsigned char)value;
-    for (size_t i = 0; i < size; i++)
+    while (*s1 != '\0' && *s1 == *s2)
     {
-        p[i] = val;
+        s1++;
+        s2++;
     }
-    return ptr;
+    return (unsigned char)*s1 - (unsigned char)*s2;
 }
 
-char *digits = "0123456789ABCDEF";
-void puthex(uint32_t number)
+int memcmp(const void *ptr1, const void *ptr2, size_t size)
 {
-    int i;
-    int started = 0;
-    for (i = 28; i >= 0; i -= 4)
+    const unsigned char *p1 = ptr1;
+    const unsigned char *p2 = ptr2;
+    for (size_t i = 0; i < size; i++)
     {
-        int k = (number >> i) & 0xF;
-        if (k != 0 || started)
+        if (p1[i] != p2[i])
         {
-            putc(digits[k]);
-            started = 1;
+            return p1[i] - p2[i];
         }
     }
-    if (!started)
-        putc('0');
+    return 0;
 }
 
-void putdec(uint32_t number)
+static void out_char(format_out_t *out, char c)
 {
-    if (number == 0)
+    if (out->pos == out->size && out->flush != NULL)
     {
-        putc('0');
-        return;
+        out->flush(out);
     }
-
-    char buffer[10];
-    int i = 0;
-    while (number > 0)
+    if (out->pos < out->size)
     {
-        buffer[i++] = digits[number % 10];
-        number /= 10;
+        out->buffer[out->pos++] = c;
     }
-    while (i-- > 0)
+    out->len++;
+}
+
+static void out_repeat(format_out_t *out, char c, int count)
+{
+    while (count-- > 0)
     {
-        putc(buffer[i]);
+        out_char(out, c);
     }
 }
 
-void putbin(uint32_t number)
+/**
+ * @brief Divides n by base in place and returns the remainder, with two 32 bits divl since there is no libgcc for __udivdi3.
+ */
+uint32_t div64(uint64_t *n, uint32_t base)
+{
+    uint32_t high = (uint32_t)(*n >> 32);
+    uint32_t low = (uint32_t)*n;
+    uint32_t rem = high % base;
+    high /= base;
+    __asm__("divl %4" : "=a"(low), "=d"(rem) : "a"(low), "d"(rem), "rm"(base));
+    *n = ((uint64_t)high << 32) | low;
+    return rem;
+}
+
+/**
+ * @brief Writes a number with its sign, the digits required by the precision and the padding up to the width.
+ */
+static void format_number(format_out_t *out, const format_spec_t *spec, uint64_t value, uint8_t negative)
 {
-    if (number == 0)
+    const char *digits = spec->flags & FORMAT_UPPER ? upper_digits : lower_digits;
+    char buffer[64]; // 64 bits in base 2
+    int nb_digits = 0;
+    while (value != 0)
     {
-        putc('0');
-        return;
+        buffer[nb_digits++] = digits[div64(&value, spec->base)];
     }
 
-    char buffer[32];
-    int i = 0;
-    while (number > 0)
+    // like printf, an explicit precision of 0 prints nothing for 0
+    int nb_zeros = spec->precision >= 0 ? spec->precision - nb_digits : (nb_digits == 0);
+    if (nb_zeros < 0)
     {
-        buffer[i++] = digits[number % 2];
-        number >>= 1;
+        nb_zeros = 0;
     }
+    int padding = spec->width - nb_digits - nb_zeros - negative;
 
-    while (i-- > 0)
+    if (spec->flags & FORMAT_ZERO && !(spec->flags & FORMAT_LEFT) && spec->precision < 0)
+    {
+        nb_zeros += padding > 0 ? padding : 0;
+        padding = 0;
+    }
+    if (!(spec->flags & FORMAT_LEFT))
+    {
+        out_repeat(out, ' ', padding);
+    }
+    if (negative)
+    {
+        out_char(out, '-');
+    }
+    out_repeat(out, '0', nb_zeros);
+    while (nb_digits-- > 0)
     {
-        putc(buffer[i]);
+        out_char(out, buffer[nb_digits]);
+    }
+    if (spec->flags & FORMAT_LEFT)
+    {
+        out_repeat(out, ' ', padding);
     }
 }
 
-void printf(const char *fmt, ...)
+static void format_string(format_out_t *out, const format_spec_t *spec, const char *str)
 {
-    char c;
-    va_list args;
+    if (str == NULL)
+    {
+        str = "(null)";
+    }
+    int len = 0;
+    while (str[len] != '\0' && (spec->precision < 0 || len < spec->precision))
+    {
+        len++;
+    }
 
-    va_start(args, fmt);
-    while ((c = *fmt) != '\0')
+    if (!(spec->flags & FORMAT_LEFT))
+    {
+        out_repeat(out, ' ', spec->width - len);
+    }
+    for (int i = 0; i < len; i++)
+    {
+        out_char(out, str[i]);
+    }
+    if (spec->flags & FORMAT_LEFT)
+    {
+        out_repeat(out, ' ', spec->width - len);
+    }
+}
+
+static int parse_int(const char **fmt)
+{
+    int value = 0;
+    while (**fmt >= '0' && **fmt <= '9')
     {
-        if (c == '%')
+        value = value * 10 + (*(*fmt)++ - '0');
+    }
+    return value;
+}
+
+/**
+ * @brief Formats %[-0][width|*][.precision|*][l|ll](d|i|u|x|X|b|o|p|s|c|%) into out.
+ */
+static void format(format_out_t *out, const char *fmt, va_list args)
+{
+    while (*fmt != '\0')
+    {
+        if (*fmt != '%')
+        {
+            out_char(out, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        format_spec_t spec = {.flags = 0, .width = 0, .precision = -1, .base = 10};
+        for (;; fmt++)
         {
-            c = *(++fmt);
-            switch (c)
+            if (*fmt == '-')
+            {
+                spec.flags |= FORMAT_LEFT;
+            }
+            else if (*fmt == '0')
+            {
+                spec.flags |= FORMAT_ZERO;
+            }
+            else
             {
-            case 'd':
-                putdec(va_arg(args, uint32_t));
-                break;
-            case 'x':
-                puthex(va_arg(args, uint32_t));
-                break;
-            case 'b':
-                putbin(va_arg(args, uint32_t));
-                break;
-            case 's':
-                puts(va_arg(args, char *));
-                break;
-            case 'c':
-                putc(va_arg(args, int));
-                break;
-            case 'p':
-                puthex((uint32_t)va_arg(args, void *));
-                break;
-            case '%':
-                putc('%');
-                break;
-            default:
                 break;
             }
         }
+
+        if (*fmt == '*')
+        {
+            spec.width = va_arg(args, int);
+            if (spec.width < 0)
+            {
+                spec.flags |= FORMAT_LEFT;
+                spec.width = -spec.width;
+            }
+            fmt++;
+        }
         else
         {
-            putc(c);
+            spec.width = parse_int(&fmt);
+        }
+
+        if (*fmt == '.')
+        {
+            fmt++;
+            if (*fmt == '*')
+            {
+                spec.precision = va_arg(args, int);
+                fmt++;
+            }
+            else
+            {
+                spec.precision = parse_int(&fmt);
+            }
+        }
+
+        uint8_t longs = 0;
+        while (*fmt == 'l')
+        {
+            longs++;
+            fmt++;
+        }
+
+        uint64_t value = 0;
+        uint8_t negative = 0;
+        char c = *fmt;
+        switch (c)
+        {
+        case 'd':
+        case 'i':
+        {
+            int64_t number = longs >= 2 ? va_arg(args, int64_t) : va_arg(args, int32_t);
+            negative = number < 0;
+            value = negative ? -(uint64_t)number : (uint64_t)number;
+            format_number(out, &spec, value, negative);
+            break;
+        }
+
+        case 'X':
+            spec.flags |= FORMAT_UPPER;
+            // fall through
+        case 'x':
+        case 'u':
+        case 'o':
+        case 'b':
+            spec.base = c == 'u' ? 10 : c == 'o' ? 8 : c == 'b' ? 2 : 16;
+            value = longs >= 2 ? va_arg(args, uint64_t) : va_arg(args, uint32_t);
+            format_number(out, &spec, value, 0);
+            break;
+
+        case 'p':
+            spec.base = 16;
+            spec.flags |= FORMAT_ZERO;
+            spec.width = 8;
+            out_char(out, '0');
+            out_char(out, 'x');
+            format_number(out, &spec, (uint32_t)va_arg(args, void *), 0);
+            break;
+
+        case 's':
+            format_string(out, &spec, va_arg(args, const char *));
+            break;
+
+        case 'c':
+        {
+            char str[2] = {(char)va_arg(args, int), '\0'};
+            spec.precision = 1;
+            format_string(out, &spec, str);
+            break;
+        }
+
+        case '%':
+            out_char(out, '%');
+            break;
+
+        case '\0':
+            return;
+
+        default:
+            out_char(out, '%');
+            out_char(out, c);
+            break;
         }
         fmt++;
     }
 }
+
+int vsnprintf(char *buffer, size_t size, const char *fmt, va_list args)
+{
+    format_out_t out = {.buffer = buffer, .size = size > 0 ? size - 1 : 0, .pos = 0, .len = 0, .flush = NULL};
+    format(&out, fmt, args);
+    if (size > 0)
+    {
+        buffer[out.pos] = '\0';
+    }
+    return out.len;
+}
+
+int snprintf(char *buffer, size_t size, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buffer, size, fmt, args);
+    va_end(args);
+    return len;
+}
+
+static void flush_to_console(format_out_t *out)
+{
+    console_write(out->buffer, out->pos);
+    out->pos = 0;
+}
+
+/**
+ * @brief Formats into a stack buffer and hands it to the console in one write,
+ * a longer output is written each time the buffer fills up.
+ */
+void printf(const char *fmt, ...)
+{
+    char buffer[PRINTF_BUFFER];
+    format_out_t out = {.buffer = buffer, .size = sizeof(buffer), .pos = 0, .len = 0, .flush = flush_to_console};
+
+    va_list args;
+    va_start(args, fmt);
+    format(&out, fmt, args);
+    va_end(args);
+    flush_to_console(&out);
+}
\ No newline at end of file
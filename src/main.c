@@ -1,42 +1,78 @@
 #include "lib.h"
-// #include "gdt.h"
-// #include "idt.h"
+#include "gdt.h"
+#include "idt.h"
 #include "mmu.h"
+#include "vm.h"
+#include "syscall.h"
 #include "keyboard.h"
+#include "bench.h"
+#include "buddy.h"
+#include "swap.h"
+#include "uart.h"
+#include "apic.h"
+#include "softirq.h"
+#include "clock.h"
+#include "timer.h"
 
 extern __attribute__((fastcall)) void switch_user(uint32_t stack_top);
 
-void syscall_handler(struct regs *r)
+/**
+ * @brief Creates the address space of the user program: its image, an empty heap right after it and a stack
+ * below the kernel, all mapped on the first access.
+ */
+static mm_t *create_user_mm(void)
 {
-    printf("syscall\n");
-    r->eax = 1;
-}
-
-extern char *user_stack_top;
+    extern char _user_start;
+    extern char _user_end;
+    uint32_t user_start = (uint32_t)&_user_start;
+    uint32_t user_end = (uint32_t)&_user_end;
 
-void timer_irq(void)
-{
-    printf("timer\n");
+    mm_t *mm = mm_create();
+    if (mm == NULL ||
+        mm_add_vma(mm, user_start, user_end, VMA_READ | VMA_WRITE, user_start) == NULL ||
+        (mm->heap = mm_add_vma(mm, user_end, user_end, VMA_READ | VMA_WRITE, 0)) == NULL ||
+        (mm->stack = mm_add_vma(mm, USER_STACK_TOP - PAGE_SIZE, USER_STACK_TOP, VMA_READ | VMA_WRITE | VMA_GROWSDOWN, 0)) == NULL)
+    {
+        printf("no memory for the user address space\n");
+        for (;;)
+            ;
+    }
+    mm->brk = user_end;
+    return mm;
 }
 
 void main(void)
 {
     // init_screen();
-    // init_key_map();
-    // // init_gdt();
-    // // init_idt();
-    // init_mmu();
+    init_keyboard();
+    init_gdt();
+    init_idt();
+    init_apic();
+    init_softirq();
+    init_clock();
+    init_timer();
+    init_sysenter();
 
-    // set_irq_handler(0x20, timer_irq);
-    // set_irq_handler(0x21, keyboard_handler);
-    // set_int_handler(0x80, syscall_handler, 3);
-    // set_fault_handler(0xE, page_fault_handler);
+    set_irq_handler(IRQ_BASE + 1, keyboard_handler);
+    set_irq_handler(COM1_IRQ, uart_irq_handler);
+    uart_enable_irq();
+    set_int_handler(SYSCALL_VECTOR, syscall_handler, 3);
+    set_fault_handler(0xE, page_fault_handler);
 
-    // enable_mmu();
+    init_swap();
 
-    // printf("Hello World !\n");
-    // __asm__ volatile("sti");
-    // switch_user((uint32_t)user_stack_top);
+#ifdef BENCH
+    bench_address_space_switch(10000);
+    bench_mem();
+    bench_interrupts();
+#endif
+
+    mm_switch(create_user_mm());
+    zero_pool_refill();
+
+    printf("Hello World !\n");
+    __asm__ volatile("sti");
+    switch_user(USER_STACK_TOP);
     for (;;)
         ;
-}
+}
\ No newline at end of file
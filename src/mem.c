@@ -0,0 +1,332 @@
+#include "mem.h"
+#include "lib.h"
+#include "cpu.h"
+
+/*
+ * Linked in .boot with lib.o since memset is called before paging: until init_mem runs,
+ * no feature is known and only the rep string variants, valid on every i386, are picked.
+ */
+
+#define MEM_SMALL 64           // below, the setup of a wider variant costs more than a plain rep movsb/stosb
+#define MEM_NON_TEMPORAL 4096  // fills of a page or more go around the cache, they are rarely read back soon
+#define MEM_BLOCK 32           // bytes moved by each iteration of the SSE2 and movnti loops
+
+#define MEM_ERMS 1
+#define MEM_SSE2 2
+
+typedef void (*mem_set_t)(uint8_t *dest, uint8_t value, size_t size);
+typedef void (*mem_copy_t)(uint8_t *dest, const uint8_t *src, size_t size);
+
+static uint8_t mem_features = 0;
+
+static void set_loop(uint8_t *dest, uint8_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        dest[i] = value;
+    }
+}
+
+static void set_rep_byte(uint8_t *dest, uint8_t value, size_t size)
+{
+    __asm__ volatile("rep stosb" : "+D"(dest), "+c"(size) : "a"(value) : "memory");
+}
+
+static void set_rep_dword(uint8_t *dest, uint8_t value, size_t size)
+{
+    size_t words = size / 4;
+    __asm__ volatile("rep stosl\n movl %3, %%ecx\n rep stosb"
+                     : "+D"(dest), "+c"(words) : "a"(value * 0x01010101u), "r"(size % 4) : "memory");
+}
+
+/**
+ * @brief Number of bytes to set one by one before dest is aligned on 16 bytes, the wide loops need it.
+ */
+static size_t head_size(const uint8_t *dest, size_t size)
+{
+    size_t head = -(uint32_t)dest & 15;
+    return head < size ? head : size;
+}
+
+/**
+ * @brief Stores 32 bytes per iteration with movdqa, xmm0 is saved around the loop since nothing else saves the SSE state.
+ */
+static void set_sse2(uint8_t *dest, uint8_t value, size_t size)
+{
+    size_t head = head_size(dest, size);
+    set_rep_byte(dest, value, head);
+    dest += head;
+    size -= head;
+
+    size_t blocks = size & ~(MEM_BLOCK - 1);
+    if (blocks != 0)
+    {
+        uint8_t saved[16];
+        __asm__ volatile("movdqu %%xmm0, (%[saved])\n"
+                         "movd %[pattern], %%xmm0\n"
+                         "pshufd $0, %%xmm0, %%xmm0\n"
+                         "1:\n"
+                         "movdqa %%xmm0, (%[dest])\n"
+                         "movdqa %%xmm0, 16(%[dest])\n"
+                         "addl $32, %[dest]\n"
+                         "subl $32, %[blocks]\n"
+                         "jnz 1b\n"
+                         "movdqu (%[saved]), %%xmm0"
+                         : [dest] "+r"(dest), [blocks] "+r"(blocks)
+                         : [pattern] "r"(value * 0x01010101u), [saved] "r"(saved)
+                         : "memory", "cc");
+    }
+    set_rep_byte(dest, value, size % MEM_BLOCK);
+}
+
+static void set_non_temporal(uint8_t *dest, uint8_t value, size_t size)
+{
+    size_t head = head_size(dest, size);
+    set_rep_byte(dest, value, head);
+    dest += head;
+    size -= head;
+
+    size_t blocks = size & ~(MEM_BLOCK - 1);
+    if (blocks != 0)
+    {
+        __asm__ volatile("1:\n"
+                         "movnti %[pattern], (%[dest])\n"
+                         "movnti %[pattern], 4(%[dest])\n"
+                         "movnti %[pattern], 8(%[dest])\n"
+                         "movnti %[pattern], 12(%[dest])\n"
+                         "movnti %[pattern], 16(%[dest])\n"
+                         "movnti %[pattern], 20(%[dest])\n"
+                         "movnti %[pattern], 24(%[dest])\n"
+                         "movnti %[pattern], 28(%[dest])\n"
+                         "addl $32, %[dest]\n"
+                         "subl $32, %[blocks]\n"
+                         "jnz 1b\n"
+                         "sfence"
+                         : [dest] "+r"(dest), [blocks] "+r"(blocks)
+                         : [pattern] "r"(value * 0x01010101u)
+                         : "memory", "cc");
+    }
+    set_rep_byte(dest, value, size % MEM_BLOCK);
+}
+
+static void copy_loop(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        dest[i] = src[i];
+    }
+}
+
+static void copy_rep_byte(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    __asm__ volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(size)::"memory");
+}
+
+static void copy_rep_dword(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    size_t words = size / 4;
+    __asm__ volatile("rep movsl\n movl %3, %%ecx\n rep movsb"
+                     : "+D"(dest), "+S"(src), "+c"(words) : "r"(size % 4) : "memory");
+}
+
+/**
+ * @brief Copies 32 bytes per iteration, unaligned loads and aligned stores, with xmm0 and xmm1 saved around the loop.
+ */
+static void copy_sse2(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    size_t head = head_size(dest, size);
+    copy_rep_byte(dest, src, head);
+    dest += head;
+    src += head;
+    size -= head;
+
+    size_t blocks = size & ~(MEM_BLOCK - 1);
+    if (blocks != 0)
+    {
+        uint8_t saved[32];
+        __asm__ volatile("movdqu %%xmm0, (%[saved])\n"
+                         "movdqu %%xmm1, 16(%[saved])\n"
+                         "1:\n"
+                         "movdqu (%[src]), %%xmm0\n"
+                         "movdqu 16(%[src]), %%xmm1\n"
+                         "movdqa %%xmm0, (%[dest])\n"
+                         "movdqa %%xmm1, 16(%[dest])\n"
+                         "addl $32, %[src]\n"
+                         "addl $32, %[dest]\n"
+                         "subl $32, %[blocks]\n"
+                         "jnz 1b\n"
+                         "movdqu (%[saved]), %%xmm0\n"
+                         "movdqu 16(%[saved]), %%xmm1"
+                         : [dest] "+r"(dest), [src] "+r"(src), [blocks] "+r"(blocks)
+                         : [saved] "r"(saved)
+                         : "memory", "cc");
+    }
+    copy_rep_byte(dest, src, size % MEM_BLOCK);
+}
+
+static void copy_non_temporal(uint8_t *dest, const uint8_t *src, size_t size)
+{
+    size_t head = head_size(dest, size);
+    copy_rep_byte(dest, src, head);
+    dest += head;
+    src += head;
+    size -= head;
+
+    size_t blocks = size & ~(MEM_BLOCK - 1);
+    if (blocks != 0)
+    {
+        __asm__ volatile("1:\n"
+                         "movl (%[src]), %%eax\n"
+                         "movl 4(%[src]), %%edx\n"
+                         "movnti %%eax, (%[dest])\n"
+                         "movnti %%edx, 4(%[dest])\n"
+                         "addl $8, %[src]\n"
+                         "addl $8, %[dest]\n"
+                         "subl $8, %[blocks]\n"
+                         "jnz 1b\n"
+                         "sfence"
+                         : [dest] "+r"(dest), [src] "+r"(src), [blocks] "+r"(blocks)
+                         :
+                         : "eax", "edx", "memory", "cc");
+    }
+    copy_rep_byte(dest, src, size % MEM_BLOCK);
+}
+
+static const mem_set_t set_impls[NB_MEM_IMPLS] = {
+    [MEM_IMPL_LOOP] = set_loop,
+    [MEM_IMPL_REP_BYTE] = set_rep_byte,
+    [MEM_IMPL_REP_DWORD] = set_rep_dword,
+    [MEM_IMPL_SSE2] = set_sse2,
+    [MEM_IMPL_NON_TEMPORAL] = set_non_temporal,
+};
+
+static const mem_copy_t copy_impls[NB_MEM_IMPLS] = {
+    [MEM_IMPL_LOOP] = copy_loop,
+    [MEM_IMPL_REP_BYTE] = copy_rep_byte,
+    [MEM_IMPL_REP_DWORD] = copy_rep_dword,
+    [MEM_IMPL_SSE2] = copy_sse2,
+    [MEM_IMPL_NON_TEMPORAL] = copy_non_temporal,
+};
+
+static const char *impl_names[NB_MEM_IMPLS] = {
+    [MEM_IMPL_LOOP] = "loop",
+    [MEM_IMPL_REP_BYTE] = "rep_byte",
+    [MEM_IMPL_REP_DWORD] = "rep_dword",
+    [MEM_IMPL_SSE2] = "sse2",
+    [MEM_IMPL_NON_TEMPORAL] = "movnti",
+};
+
+/**
+ * @brief Detects ERMS and SSE2 and enables the SSE instructions, which fault with #UD until CR4.OSFXSR is set.
+ */
+void init_mem(void)
+{
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_EDX_SSE2)
+    {
+        write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+        write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+        mem_features |= MEM_SSE2;
+    }
+    if (max_leaf >= CPUID_EXTENDED_FEATURES)
+    {
+        cpuid(CPUID_EXTENDED_FEATURES, &eax, &ebx, &ecx, &edx);
+        if (ebx & CPUID_EBX_ERMS)
+        {
+            mem_features |= MEM_ERMS;
+        }
+    }
+    printf("mem: erms %d, sse2 %d\n", (mem_features & MEM_ERMS) != 0, (mem_features & MEM_SSE2) != 0);
+}
+
+uint8_t mem_impl_supported(mem_impl_t impl)
+{
+    if (impl == MEM_IMPL_SSE2 || impl == MEM_IMPL_NON_TEMPORAL)
+    {
+        return (mem_features & MEM_SSE2) != 0;
+    }
+    return impl < NB_MEM_IMPLS;
+}
+
+const char *mem_impl_name(mem_impl_t impl)
+{
+    return impl < NB_MEM_IMPLS ? impl_names[impl] : "?";
+}
+
+void *memset_impl(mem_impl_t impl, void *ptr, int value, size_t size)
+{
+    set_impls[impl](ptr, (uint8_t)value, size);
+    return ptr;
+}
+
+void *memcpy_impl(mem_impl_t impl, void *dest, const void *src, size_t size)
+{
+    copy_impls[impl](dest, src, size);
+    return dest;
+}
+
+/**
+ * @brief Picks the variant for a size from the bench_mem results: rep string for small sizes and on ERMS CPUs,
+ * the SSE2 loop otherwise, and non temporal stores for the page sized fills.
+ */
+static mem_impl_t select_impl(size_t size, uint8_t fill)
+{
+    if (size < MEM_SMALL)
+    {
+        return MEM_IMPL_REP_BYTE;
+    }
+    if (fill && size >= MEM_NON_TEMPORAL && (mem_features & MEM_SSE2))
+    {
+        return MEM_IMPL_NON_TEMPORAL;
+    }
+    if (mem_features & MEM_ERMS)
+    {
+        return MEM_IMPL_REP_BYTE;
+    }
+    if (mem_features & MEM_SSE2)
+    {
+        return MEM_IMPL_SSE2;
+    }
+    return MEM_IMPL_REP_DWORD;
+}
+
+void *memset(void *ptr, int value, size_t size)
+{
+    set_impls[select_impl(size, 1)](ptr, (uint8_t)value, size);
+    return ptr;
+}
+
+void *memcpy(void *dest, const void *src, size_t size)
+{
+    copy_impls[select_impl(size, 0)](dest, src, size);
+    return dest;
+}
+
+/**
+ * @brief Copies forward when dest does not overlap the end of src, otherwise backward with DF set,
+ * the trailing bytes first so the dwords that follow stay aligned with the end of the buffers.
+ */
+void *memmove(void *dest, const void *src, size_t size)
+{
+    if ((uint32_t)dest - (uint32_t)src >= size)
+    {
+        return memcpy(dest, src, size);
+    }
+
+    uint8_t *d = (uint8_t *)dest + size - 1;
+    const uint8_t *s = (const uint8_t *)src + size - 1;
+    size_t bytes = size % 4;
+    __asm__ volatile("std\n"
+                     "rep movsb\n"
+                     "subl $3, %%edi\n"
+                     "subl $3, %%esi\n"
+                     "movl %3, %%ecx\n"
+                     "rep movsl\n"
+                     "cld"
+                     : "+D"(d), "+S"(s), "+c"(bytes)
+                     : "r"(size / 4)
+                     : "memory", "cc");
+    return dest;
+}
\ No newline at end of file
@@ -1,39 +1,43 @@
 #include "mmu.h"
+#include "buddy.h"
+#include "multiboot.h"
+#include "cpu.h"
+#include "vm.h"
+#include "rmap.h"
+#include "swap.h"
+#include "klog.h"
+#include "console.h"
 
-#define PAGE_SIZE 4096
 #define NUM_ENTRIES 1024
-#define NUM_DIRECTORIES 1024
-#define NB_PAGES NUM_DIRECTORIES
+#define RECURSIVE_INDEX (NUM_ENTRIES - 1)
+#define INVLPG_MAX 32 // past this many pages a flush reloads CR3 instead of invalidating them one by one
 
-#define KERNEL_DIR 0
+// a not present user entry holding this bit stores the swap slot of its page in place of the frame
+#define SWAP_ENTRY 0x2
+#define IS_SWAP_ENTRY(entry) (!(entry).valid && (entry).write_access)
 
-#define KERNEL_MODE 0
-#define USER_MODE 1
-
-#define RO_MODE 0
-#define RW_MODE 1
-
-#define CR0_PG 0x80000000
-
-#define SET_CR3(pd) ({                            \
-    __asm__ volatile("movl %0, %%cr3" ::"r"(pd)); \
-})
-
-#define PAGE_TO_ADDR(page) ((void *)((uintptr_t)page << 12))
-#define ADDR_TO_PAGE(addr) ((uint32_t)((uintptr_t)addr >> 12))
+// PAT entries, indexed by PAT << 2 | PCD << 1 | PWT, so mem_type_t values are indexes
+#define PAT_UC 0x00
+#define PAT_WC 0x01
+#define PAT_WT 0x04
+#define PAT_WB 0x06
+#define PAT_UC_MINUS 0x07
+#define PAT_VALUE ((uint64_t)PAT_WB | (uint64_t)PAT_WC << 8 | (uint64_t)PAT_UC_MINUS << 16 | (uint64_t)PAT_UC << 24 | \
+                   (uint64_t)PAT_WT << 32 | (uint64_t)PAT_WC << 40 | (uint64_t)PAT_UC_MINUS << 48 | (uint64_t)PAT_UC << 56)
 
 typedef struct
 {
     uint8_t valid : 1;          // 1 valid, 0 invalid
     uint8_t write_access : 1;   // 1 read/write, 0 read only
     uint8_t access_mode : 1;    // 0 user mode, 1 kernel mode
-    uint8_t cache_defer : 1;    // 0 write-through, 1 write-back (defer)
-    uint8_t cache_disabled : 1; // 0 cache enabled, 1 cache disabled
+    uint8_t cache_defer : 1;    // PWT, bit 0 of the PAT index
+    uint8_t cache_disabled : 1; // PCD, bit 1 of the PAT index
     uint8_t used : 1;           // 1 if the page has been read
     uint8_t _pad2 : 1;
-    uint8_t size : 1; // 0 => 4Ko, 1 => 4Mo
-    uint8_t _pad1 : 4;
-    uint32_t page_table : 20; // 20 bits page address
+    uint8_t size : 1;   // 0 => 4Ko, 1 => 4Mo
+    uint8_t global : 1; // 1 if the 4Mo page is global
+    uint8_t _pad1 : 3;
+    uint32_t page_table : 20; // 20 bits page address, for a 4Mo page its lowest bit is bit 2 of the PAT index
 } __attribute__((packed)) directory_entry_t;
 
 typedef struct
@@ -41,160 +45,1099 @@ typedef struct
     uint8_t valid : 1;          // 1 valid, 0 invalid
     uint8_t write_access : 1;   // 1 read/write, 0 read only
     uint8_t access_mode : 1;    // 1 user mode, 0 kernel mode
-    uint8_t cache_defer : 1;    // 0 write-through, 1 write-back (defer)
-    uint8_t cache_disabled : 1; // 0 cache enabled, 1 cache disabled
+    uint8_t cache_defer : 1;    // PWT, bit 0 of the PAT index
+    uint8_t cache_disabled : 1; // PCD, bit 1 of the PAT index
     uint8_t read : 1;           // 1 if the page has been read
     uint8_t dirty : 1;          // 1 if the page has been written
-    uint8_t _pad2 : 1;
+    uint8_t pat : 1;            // bit 2 of the PAT index
     uint8_t global : 1; // 1 if the page is global
-    uint8_t _pad1 : 3;
+    uint8_t anon : 1;   // available bit, the frame is refcounted by the VM (MAP_ANON)
+    uint8_t _pad1 : 2;
     uint32_t physical_page : 20; // 20 bits page entry
 } __attribute__((packed)) page_entry_t;
 
 directory_entry_t page_directory[NUM_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
 
-int32_t first_free_page = 0;
-int32_t pages[NUM_DIRECTORIES];
+// the current address space seen through its recursive entry, only once paging is on
+#define CURRENT_PAGE_TABLES ((page_entry_t *)PAGE_TABLES_BASE)
+#define CURRENT_DIRECTORY ((directory_entry_t *)(PAGE_TABLES_BASE + RECURSIVE_INDEX * PAGE_SIZE))
 
-void init_pages(void)
+typedef struct
 {
-    for (int i = 0; i < NB_PAGES - 1; i++)
+    uint32_t addrs[INVLPG_MAX];
+    uint32_t nb_addrs;
+    uint8_t global; // a global entry changed, a CR3 reload is not enough
+} tlb_batch_t;
+
+static uint32_t nb_invlpg = 0;
+static uint32_t nb_full_flushes = 0;
+
+memory_region_t memory_regions[MAX_MEMORY_REGIONS];
+uint32_t nb_memory_regions = 0;
+uint32_t lowmem_end = 0;
+uint32_t direct_map_offset = 0;
+uint32_t kernel_directory = 0;
+
+static uint8_t large_pages = 0; // CR4.PSE is on
+static uint8_t pat_enabled = 0;  // IA32_PAT holds PAT_VALUE
+static uint8_t global_pages = 0; // the CPU supports CR4.PGE
+
+static const char *mem_type_names[] = {"WB", "WC", "UC-", "UC", "WT"};
+
+static uint32_t kmap_used = 0; // bitmap of the KMAP_SLOTS slots
+
+static uint32_t boot_alloc_start = 0;
+static uint32_t boot_alloc_next = 0;
+
+/**
+ * @brief Records a free memory region, minus the parts overlapping the reserved ranges.
+ */
+static void add_memory_region(uint32_t start, uint32_t end, const memory_region_t *reserved, uint32_t nb_reserved)
+{
+    for (uint32_t i = 0; i < nb_reserved; i++)
+    {
+        if (reserved[i].start < end && reserved[i].end > start)
+        {
+            if (start < reserved[i].start)
+            {
+                add_memory_region(start, reserved[i].start, &reserved[i + 1], nb_reserved - i - 1);
+            }
+            if (reserved[i].end < end)
+            {
+                add_memory_region(reserved[i].end, end, &reserved[i + 1], nb_reserved - i - 1);
+            }
+            return;
+        }
+    }
+
+    if (start < end && nb_memory_regions < MAX_MEMORY_REGIONS)
     {
-        pages[i] = i + 1;
+        memory_regions[nb_memory_regions].start = start;
+        memory_regions[nb_memory_regions].end = end;
+        nb_memory_regions++;
     }
-    pages[NB_PAGES - 1] = -1;
 }
 
-void *alloc_page(void)
+/**
+ * @brief Builds memory_regions from the multiboot2 memory map, leaving out the BIOS area,
+ * the VGA memory, the kernel image, the user image and the multiboot information itself.
+ */
+static void init_memory_regions(void)
 {
-    uint32_t page = first_free_page;
-    if (first_free_page == -1)
+    multiboot_tag_mmap_t *mmap = (multiboot_tag_mmap_t *)multiboot_find_tag(MULTIBOOT_TAG_TYPE_MMAP);
+    if (mmap == NULL)
     {
-        return NULL;
+        printf("mmu: no memory map given by the bootloader\n");
+        for (;;)
+            ;
     }
-    first_free_page = pages[page];
-    pages[page] = -1;
-    return PAGE_TO_ADDR(page);
+
+    extern char _kernel_stack_top;
+    extern char _user_start;
+    extern char _user_end;
+    uint32_t info = (uint32_t)multiboot_info;
+    memory_region_t reserved[] = {
+        {0, (uint32_t)&_kernel_stack_top - KERNEL_VIRT_BASE},
+        {(uint32_t)&_user_start, (uint32_t)&_user_end},
+        {PAGE_ALIGN_DOWN(info), PAGE_ALIGN_UP(info + multiboot_info->total_size)},
+    };
+
+    uint32_t memory_end = 0;
+    uint8_t *entry = (uint8_t *)mmap->entries;
+    while (entry < (uint8_t *)mmap + mmap->size)
+    {
+        multiboot_mmap_entry_t *region = (multiboot_mmap_entry_t *)entry;
+        entry += mmap->entry_size;
+        if (region->type != MULTIBOOT_MEMORY_AVAILABLE || region->addr >= 0x100000000ULL)
+        {
+            continue;
+        }
+
+        uint64_t region_end = region->addr + region->len;
+        uint32_t start = PAGE_ALIGN_UP((uint32_t)region->addr);
+        uint32_t end = region_end > 0xFFFFF000ULL ? 0xFFFFF000 : PAGE_ALIGN_DOWN((uint32_t)region_end);
+        if (start >= end)
+        {
+            continue;
+        }
+        add_memory_region(start, end, reserved, sizeof(reserved) / sizeof(memory_region_t));
+        if (end > memory_end)
+        {
+            memory_end = end;
+        }
+    }
+    lowmem_end = memory_end < DIRECT_MAP_SIZE ? memory_end : DIRECT_MAP_SIZE;
 }
 
-// void free_page(void *page_address)
-// {
-//     uint32_t page = ADDR_TO_PAGE(page_address);
-//     pages[page] = first_free_page;
-//     first_free_page = page;
-// }
+/**
+ * @brief Hands out physically contiguous pages before the buddy allocator exists.
+ * It only moves forward through memory_regions below lowmem_end, init_buddy() freezes it.
+ *
+ * @return The physical address of the first page, 0 if no region has room left.
+ */
+uint32_t boot_alloc_pages(uint32_t nb_pages)
+{
+    uint32_t size = nb_pages * PAGE_SIZE;
+    for (uint32_t i = 0; i < nb_memory_regions; i++)
+    {
+        uint32_t start = memory_regions[i].start > boot_alloc_next ? memory_regions[i].start : boot_alloc_next;
+        uint32_t end = memory_regions[i].end < lowmem_end ? memory_regions[i].end : lowmem_end;
+        if (start >= end || end - start < size)
+        {
+            continue;
+        }
+
+        if (boot_alloc_start == 0)
+        {
+            boot_alloc_start = start;
+        }
+        boot_alloc_next = start + size;
+        return start;
+    }
+    return 0;
+}
 
-// void page_copy(char *pg_src, char *pg_dst)
-// {
-//     for (int i = 0; i < PAGE_SIZE; i++)
-//     {
-//         pg_dst[i] = pg_src[i];
-//     }
-// }
+void boot_alloc_range(uint32_t *start, uint32_t *end)
+{
+    *start = boot_alloc_start;
+    *end = boot_alloc_next;
+}
 
-static page_entry_t *allocate_page_table(void)
+static page_entry_t *allocate_page_table(uint32_t *phys_addr)
 {
-    void *page = alloc_page();
+    // before paging the buddy allocator is not reachable yet
+    if (direct_map_offset != 0)
+    {
+        *phys_addr = alloc_zeroed_page();
+        return *phys_addr != 0 ? phys_to_virt(*phys_addr) : NULL;
+    }
+
+    *phys_addr = boot_alloc_pages(1);
+    if (*phys_addr == 0)
+    {
+        return NULL;
+    }
+    page_entry_t *page = phys_to_virt(*phys_addr);
     memset(page, 0, sizeof(page_entry_t) * NUM_ENTRIES);
-    return (page_entry_t *)page;
+    return page;
+}
+
+/**
+ * @brief Gets the PAT index selecting a memory type. Without PAT the PWT/PCD pair alone
+ * gives WB, WT, UC- or UC, so write-combining degrades to UC-.
+ */
+static uint8_t pat_index(mem_type_t type)
+{
+    if (pat_enabled)
+    {
+        return type;
+    }
+
+    switch (type)
+    {
+    case MEM_WB:
+        return 0;
+    case MEM_WT:
+        return 1;
+    case MEM_WC:
+    case MEM_UC_MINUS:
+        return 2;
+    case MEM_UC:
+        return 3;
+    default:
+        return 3;
+    }
+}
+
+/**
+ * @brief Gets the memory type selected by the PAT index of an entry.
+ */
+static mem_type_t entry_mem_type(uint8_t pwt, uint8_t pcd, uint8_t pat)
+{
+    static const mem_type_t legacy_types[] = {MEM_WB, MEM_WT, MEM_UC_MINUS, MEM_UC};
+    uint8_t index = pat << 2 | pcd << 1 | pwt;
+    return pat_enabled ? (mem_type_t)index : legacy_types[index & 3];
+}
+
+static int setup_page_directory(directory_entry_t *directory, uint16_t directory_index, uint32_t flags)
+{
+    uint32_t page_table;
+    if (allocate_page_table(&page_table) == NULL)
+    {
+        return -1;
+    }
+    directory[directory_index].valid = 1;
+    directory[directory_index].write_access = 1;
+    directory[directory_index].access_mode = (flags & MAP_USER) != 0;
+    directory[directory_index].page_table = ADDR_TO_PAGE(page_table);
+    return 0;
+}
+
+static page_entry_t *get_page_table(directory_entry_t *directory, uint32_t virt_addr, uint32_t flags)
+{
+    uint16_t directory_index = virt_addr / LARGE_PAGE_SIZE;
+    if (!directory[directory_index].valid && setup_page_directory(directory, directory_index, flags) != 0)
+    {
+        return NULL;
+    }
+    return phys_to_virt((uint32_t)PAGE_TO_ADDR(directory[directory_index].page_table));
+}
+
+static void set_page_entry(page_entry_t *entry, uint32_t phys_addr, uint32_t flags, mem_type_t type)
+{
+    uint8_t index = pat_index(type);
+    entry->valid = 1;
+    entry->cache_defer = index & 1;
+    entry->cache_disabled = (index >> 1) & 1;
+    entry->pat = index >> 2;
+    entry->global = (flags & MAP_GLOBAL) != 0;
+    entry->anon = (flags & MAP_ANON) != 0;
+    entry->access_mode = (flags & MAP_USER) != 0;
+    entry->write_access = (flags & MAP_WRITE) != 0;
+    entry->physical_page = ADDR_TO_PAGE(phys_addr);
+    entry->read = 0;
+    entry->dirty = 0;
+}
+
+static int map_page(directory_entry_t *directory, uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, mem_type_t type)
+{
+    page_entry_t *page_table = get_page_table(directory, virt_addr, flags);
+    if (page_table == NULL)
+    {
+        return -1;
+    }
+    set_page_entry(&page_table[ADDR_TO_PAGE(virt_addr) % NUM_ENTRIES], phys_addr, flags, type);
+    return 0;
+}
+
+static void map_large_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, mem_type_t type)
+{
+    directory_entry_t *entry = &page_directory[virt_addr / LARGE_PAGE_SIZE];
+    uint8_t index = pat_index(type);
+    entry->valid = 1;
+    entry->size = 1;
+    entry->cache_defer = index & 1;
+    entry->cache_disabled = (index >> 1) & 1;
+    entry->global = (flags & MAP_GLOBAL) != 0;
+    entry->access_mode = (flags & MAP_USER) != 0;
+    entry->write_access = (flags & MAP_WRITE) != 0;
+    entry->page_table = ADDR_TO_PAGE(phys_addr) | (index >> 2);
+}
+
+/**
+ * @brief Maps size bytes of physical memory at virt_addr. A 4 MiB page is used wherever both
+ * addresses are 4 MiB aligned with at least 4 MiB left and no page table is in the way,
+ * 4 KiB pages fill the unaligned edges.
+ *
+ * @param virt_addr Page aligned virtual address.
+ * @param phys_addr Page aligned physical address.
+ * @param size Number of bytes, rounded up to a page.
+ * @param flags MAP_WRITE, MAP_USER and MAP_GLOBAL.
+ * @param type Memory type: MEM_WB for RAM, MEM_WC for framebuffers, MEM_UC for MMIO.
+ */
+void map_range(uint32_t virt_addr, uint32_t phys_addr, uint32_t size, uint32_t flags, mem_type_t type)
+{
+    uint32_t remaining = PAGE_ALIGN_UP(size);
+    while (remaining > 0)
+    {
+        if (large_pages && virt_addr % LARGE_PAGE_SIZE == 0 && phys_addr % LARGE_PAGE_SIZE == 0 &&
+            remaining >= LARGE_PAGE_SIZE && !page_directory[virt_addr / LARGE_PAGE_SIZE].valid)
+        {
+            map_large_page(virt_addr, phys_addr, flags, type);
+            virt_addr += LARGE_PAGE_SIZE;
+            phys_addr += LARGE_PAGE_SIZE;
+            remaining -= LARGE_PAGE_SIZE;
+        }
+        else
+        {
+            map_page(page_directory, virt_addr, phys_addr, flags, type);
+            virt_addr += PAGE_SIZE;
+            phys_addr += PAGE_SIZE;
+            remaining -= PAGE_SIZE;
+        }
+    }
 }
 
-static void setup_page_directory(uint16_t directory_index, uint8_t access_mode, uint8_t write_access)
+/**
+ * @brief Maps [start, end) of the direct map, keeping the read only part of the kernel image write protected.
+ */
+static void map_direct_range(uint32_t start, uint32_t end, mem_type_t type)
 {
-    page_entry_t *page_table = allocate_page_table();
-    page_directory[directory_index].valid = 1;
-    page_directory[directory_index].cache_disabled = 1;
-    page_directory[directory_index].write_access = write_access;
-    page_directory[directory_index].access_mode = access_mode;
-    page_directory[directory_index].page_table = ADDR_TO_PAGE(page_table);
+    extern char _ro_start;
+    extern char _ro_end;
+    uint32_t ro_start = (uint32_t)&_ro_start - KERNEL_VIRT_BASE;
+    uint32_t ro_end = (uint32_t)&_ro_end - KERNEL_VIRT_BASE;
+
+    end = end < lowmem_end ? end : lowmem_end;
+    if (start >= end)
+    {
+        return;
+    }
+
+    if (start < ro_end && end > ro_start)
+    {
+        uint32_t begin = start > ro_start ? start : ro_start;
+        uint32_t stop = end < ro_end ? end : ro_end;
+        map_direct_range(start, ro_start, type);
+        map_range(KERNEL_VIRT_BASE + begin, begin, stop - begin, MAP_GLOBAL, type);
+        map_direct_range(ro_end, end, type);
+        return;
+    }
+    map_range(KERNEL_VIRT_BASE + start, start, end - start, MAP_WRITE | MAP_GLOBAL, type);
 }
 
-static void setup_identity_page_range(uint32_t begin, uint32_t end, uint8_t access_mode, uint8_t write_access)
+/**
+ * @brief Maps at KERNEL_VIRT_BASE every part of [0, lowmem_end) the memory map describes:
+ * RAM write-back, firmware reserved ranges uncached. Holes such as the VGA window stay unmapped.
+ */
+static void setup_direct_map(void)
 {
-    page_entry_t *page_table = (page_entry_t *)PAGE_TO_ADDR((page_directory[begin / NUM_ENTRIES].page_table));
-    for (uint32_t i = begin; i < end; i++)
+    multiboot_tag_mmap_t *mmap = (multiboot_tag_mmap_t *)multiboot_find_tag(MULTIBOOT_TAG_TYPE_MMAP);
+    for (int pass = 0; pass < 2; pass++)
     {
-        page_table[i % NUM_ENTRIES].valid = 1;
-        page_table[i % NUM_ENTRIES].cache_disabled = 1;
-        page_table[i % NUM_ENTRIES].access_mode = access_mode;
-        page_table[i % NUM_ENTRIES].write_access = write_access;
-        page_table[i % NUM_ENTRIES].physical_page = i;
+        uint8_t *entry = (uint8_t *)mmap->entries;
+        while (entry < (uint8_t *)mmap + mmap->size)
+        {
+            multiboot_mmap_entry_t *region = (multiboot_mmap_entry_t *)entry;
+            entry += mmap->entry_size;
+            if (region->addr >= lowmem_end)
+            {
+                continue;
+            }
+
+            uint64_t region_end = region->addr + region->len;
+            uint32_t end = region_end > lowmem_end ? lowmem_end : (uint32_t)region_end;
+            uint8_t ram = region->type == MULTIBOOT_MEMORY_AVAILABLE || region->type == MULTIBOOT_MEMORY_ACPI_RECLAIMABLE ||
+                          region->type == MULTIBOOT_MEMORY_NVS;
+
+            // reserved ranges first, rounded inward, then RAM rounded outward so it wins on shared pages
+            if (pass == 0 && !ram)
+            {
+                map_direct_range(PAGE_ALIGN_UP((uint32_t)region->addr), PAGE_ALIGN_DOWN(end), MEM_UC);
+            }
+            else if (pass == 1 && ram)
+            {
+                map_direct_range(PAGE_ALIGN_DOWN((uint32_t)region->addr), PAGE_ALIGN_UP(end), MEM_WB);
+            }
+        }
     }
 }
 
-void setup_page_range(uint32_t begin, uint32_t end, uint32_t phys_addr, uint8_t access_mode, uint8_t write_access)
+/**
+ * @brief Programs IA32_PAT so PAT_VALUE gives WB, WC, UC-, UC and WT through the page entries.
+ */
+static void init_pat(void)
 {
-    page_entry_t *page_table = (page_entry_t *)PAGE_TO_ADDR((page_directory[begin / NUM_ENTRIES].page_table));
-    for (uint32_t i = begin; i < end; i++)
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_EDX_PAT)
     {
-        page_table[i % NUM_ENTRIES].valid = 1;
-        page_table[i % NUM_ENTRIES].cache_disabled = 1;
-        page_table[i % NUM_ENTRIES].access_mode = access_mode;
-        page_table[i % NUM_ENTRIES].write_access = write_access;
-        page_table[i % NUM_ENTRIES].physical_page = ADDR_TO_PAGE((phys_addr + i * PAGE_SIZE));
+        wrmsr(MSR_PAT, PAT_VALUE);
+        pat_enabled = 1;
     }
 }
 
 void init_mmu(void)
 {
-    init_pages();
-    setup_page_directory(KERNEL_DIR, KERNEL_MODE, RW_MODE);
+    init_memory_regions();
+    init_pat();
 
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_EDX_PSE)
+    {
+        write_cr4(read_cr4() | CR4_PSE);
+        large_pages = 1;
+    }
+    if (edx & CPUID_EDX_PGE)
+    {
+        global_pages = 1;
+    }
+
+    // every mapping made here is shared by all the address spaces, so it is global
     extern char _boot_start;
     extern char _boot_end;
-    uint32_t kernel_boot_start_page = ADDR_TO_PAGE(&_boot_start);
-    uint32_t kernel_boot_end_page = ADDR_TO_PAGE(&_boot_end);
-    setup_identity_page_range(kernel_boot_start_page, kernel_boot_end_page, KERNEL_MODE, RO_MODE);
+    map_range((uint32_t)&_boot_start, (uint32_t)&_boot_start, &_boot_end - &_boot_start, MAP_GLOBAL, MEM_WB);
 
     extern char _boot_rw_start;
     extern char _boot_rw_end;
-    uint32_t kernel_boot_rw_start_page = ADDR_TO_PAGE(&_boot_rw_start);
-    uint32_t kernel_boot_rw_end_page = ADDR_TO_PAGE(&_boot_rw_end);
-    setup_identity_page_range(kernel_boot_rw_start_page, kernel_boot_rw_end_page, KERNEL_MODE, RW_MODE);
+    map_range((uint32_t)&_boot_rw_start, (uint32_t)&_boot_rw_start, &_boot_rw_end - &_boot_rw_start, MAP_WRITE | MAP_GLOBAL, MEM_WB);
 
-    extern char kernel_virt_address;
-    uint32_t kernel_addr = (uint32_t)&kernel_virt_address;
-    uint16_t kernel_virt_page = kernel_addr / PAGE_SIZE / NUM_ENTRIES;
-    printf("kerne %d\n", kernel_virt_page);
-    setup_page_directory(kernel_virt_page, KERNEL_MODE, RW_MODE);
+    map_range(SCREEN_BASE, SCREEN_BASE, SCREEN_MEMORY_SIZE, MAP_WRITE | MAP_GLOBAL, MEM_WC);
 
-    uint32_t phys_kernel_addr = (uint32_t)&_boot_rw_end;
+    setup_direct_map();
 
-    extern char _ro_start;
-    extern char _ro_end;
-    uint32_t ro_start_page = ADDR_TO_PAGE(&_ro_start);
-    uint32_t ro_end_page = ADDR_TO_PAGE(&_ro_end);
-    uint32_t ro_size = &_ro_end - &_ro_start;
-    setup_page_range(ro_start_page, ro_end_page, phys_kernel_addr, KERNEL_MODE, RO_MODE);
-    printf("ro %x - %x : %x\n", ro_start_page, ro_end_page, phys_kernel_addr);
-
-    extern char _rw_start;
-    extern char _rw_end;
-    uint32_t rw_start_page = ADDR_TO_PAGE(&_rw_start);
-    uint32_t rw_end_page = ADDR_TO_PAGE(&_rw_end);
-    uint32_t rw_size = &_rw_end - &_rw_start;
-    setup_page_range(rw_start_page, rw_end_page, phys_kernel_addr + ro_size, KERNEL_MODE, RW_MODE);
-    printf("rw %x - %x : %x\n", rw_start_page, rw_end_page, phys_kernel_addr + ro_size);
-
-    extern char _kernel_stack_bot;
-    extern char _kernel_stack_top;
-    uint32_t kernel_stack_start_page = ADDR_TO_PAGE(&_kernel_stack_bot);
-    uint32_t kernel_stack_end_page = ADDR_TO_PAGE(&_kernel_stack_top);
-    setup_page_range(kernel_stack_start_page, kernel_stack_end_page, phys_kernel_addr + ro_size + rw_size, KERNEL_MODE, RW_MODE);
-    printf("rw %x - %x : %x\n", kernel_stack_start_page, kernel_stack_end_page, phys_kernel_addr + ro_size + rw_size);
+    // the kernel window page tables are created now so that every address space shares them
+    for (uint32_t virt_addr = VMALLOC_START; virt_addr < PAGE_TABLES_BASE; virt_addr += LARGE_PAGE_SIZE)
+    {
+        get_page_table(page_directory, virt_addr, 0);
+    }
+
+    kernel_directory = (uint32_t)page_directory;
+    page_directory[RECURSIVE_INDEX].valid = 1;
+    page_directory[RECURSIVE_INDEX].write_access = 1;
+    page_directory[RECURSIVE_INDEX].page_table = ADDR_TO_PAGE(kernel_directory);
+    write_cr3(kernel_directory);
+    set_global_pages(1);
+}
+
+/**
+ * @brief Turns CR4.PGE on or off, which also drops every TLB entry, global ones included.
+ */
+void set_global_pages(uint8_t enabled)
+{
+    if (!global_pages)
+    {
+        return;
+    }
+    uint32_t cr4 = read_cr4() & ~CR4_PGE;
+    write_cr4(cr4);
+    if (enabled)
+    {
+        write_cr4(cr4 | CR4_PGE);
+    }
+}
+
+/**
+ * @brief Drops every TLB entry. A CR3 reload keeps the global ones, toggling CR4.PGE does not.
+ */
+void flush_tlb_all(void)
+{
+    uint32_t cr4 = read_cr4();
+    if (cr4 & CR4_PGE)
+    {
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    }
+    else
+    {
+        write_cr3(read_cr3());
+    }
+}
+
+/**
+ * @brief Gets the page table entry of a user address, NULL if its page table does not exist.
+ */
+static page_entry_t *get_user_entry(uint32_t directory, uint32_t virt_addr)
+{
+    directory_entry_t *directory_entry = &((directory_entry_t *)phys_to_virt(directory))[virt_addr / LARGE_PAGE_SIZE];
+    if (!directory_entry->valid)
+    {
+        return NULL;
+    }
+    return &((page_entry_t *)phys_to_virt(directory_entry->page_table * PAGE_SIZE))[ADDR_TO_PAGE(virt_addr) % NUM_ENTRIES];
+}
+
+/**
+ * @brief Gets the physical address of the page table mapping a user address.
+ */
+static uint32_t user_table(uint32_t directory, uint32_t virt_addr)
+{
+    return ((directory_entry_t *)phys_to_virt(directory))[virt_addr / LARGE_PAGE_SIZE].page_table * PAGE_SIZE;
+}
+
+/**
+ * @brief Maps a write-back user page in a page directory, replacing any previous mapping of the page.
+ *
+ * @param directory Physical address of the page directory, below lowmem_end.
+ * @param flags MAP_WRITE and MAP_ANON, MAP_USER is implied.
+ * @return 0 on success, -1 if no page is left for the page table or the rmap, the previous mapping is then kept.
+ */
+int map_user_page(uint32_t directory, uint32_t virt_addr, uint32_t phys_addr, uint32_t flags)
+{
+    page_entry_t *entry = get_user_entry(directory, virt_addr);
+    page_entry_t old = entry != NULL ? *entry : (page_entry_t){0};
+
+    if (map_page(phys_to_virt(directory), virt_addr, phys_addr, flags | MAP_USER, MEM_WB) != 0)
+    {
+        return -1;
+    }
+    // the new page joins the rmap before the old one leaves it, so a failure can put the old entry back as it was
+    uint32_t table = user_table(directory, virt_addr);
+    uint32_t index = ADDR_TO_PAGE(virt_addr) % NUM_ENTRIES;
+    int res = 0;
+    if ((flags & MAP_ANON) && rmap_add(phys_addr, table, index) != 0)
+    {
+        *get_user_entry(directory, virt_addr) = old;
+        res = -1;
+    }
+    else if (old.valid && old.anon)
+    {
+        rmap_remove(old.physical_page * PAGE_SIZE, table, index);
+    }
+    if (read_cr3() == directory)
+    {
+        invlpg(virt_addr);
+    }
+    return res;
+}
+
+static uint32_t entry_flags(page_entry_t *entry)
+{
+    return (entry->write_access ? MAP_WRITE : 0) | (entry->access_mode ? MAP_USER : 0) | (entry->anon ? MAP_ANON : 0);
+}
+
+/**
+ * @brief Gets the physical address a user page is mapped to, 0 if it is not mapped.
+ *
+ * @param flags Receives the MAP_WRITE, MAP_USER and MAP_ANON flags of the mapping.
+ */
+uint32_t get_user_page(uint32_t directory, uint32_t virt_addr, uint32_t *flags)
+{
+    page_entry_t *entry = get_user_entry(directory, virt_addr);
+    if (entry == NULL || !entry->valid)
+    {
+        return 0;
+    }
+    *flags = entry_flags(entry);
+    return entry->physical_page * PAGE_SIZE;
+}
+
+/**
+ * @brief Gets the swap slot holding a user page, SWAP_NONE if it is not swapped out.
+ */
+uint32_t get_user_swap_slot(uint32_t directory, uint32_t virt_addr)
+{
+    page_entry_t *entry = get_user_entry(directory, virt_addr);
+    if (entry == NULL || !IS_SWAP_ENTRY(*entry))
+    {
+        return SWAP_NONE;
+    }
+    return entry->physical_page;
+}
+
+/**
+ * @brief Removes the mapping of a user page, or its swap entry. Its page table must not be shared.
+ * @return The physical address it was mapped to, 0 if it was not mapped.
+ */
+uint32_t unmap_user_page(uint32_t directory, uint32_t virt_addr, uint32_t *flags)
+{
+    page_entry_t *entry = get_user_entry(directory, virt_addr);
+    if (entry != NULL && IS_SWAP_ENTRY(*entry))
+    {
+        swap_free(entry->physical_page);
+        *(uint32_t *)entry = 0;
+    }
+    if (entry == NULL || !entry->valid)
+    {
+        return 0;
+    }
+
+    uint32_t phys_addr = entry->physical_page * PAGE_SIZE;
+    *flags = entry_flags(entry);
+    if (entry->anon)
+    {
+        rmap_remove(phys_addr, user_table(directory, virt_addr), ADDR_TO_PAGE(virt_addr) % NUM_ENTRIES);
+    }
+    *(uint32_t *)entry = 0;
+    if (read_cr3() == directory)
+    {
+        invlpg(virt_addr);
+    }
+    return phys_addr;
+}
+
+static void flush_user_tlb(uint32_t directory)
+{
+    if (read_cr3() == directory)
+    {
+        write_cr3(directory);
+    }
+}
+
+/**
+ * @brief Makes a child page directory share every user page table of another one. Shared tables are
+ * write protected at the directory level, so the first write of either side goes through unshare_user_page_table().
+ * The page tables are refcounted with their frame, the pages and swap slots they map are not until the tables are unshared.
+ */
+void share_user_page_tables(uint32_t directory, uint32_t child)
+{
+    directory_entry_t *entries = phys_to_virt(directory);
+    directory_entry_t *child_entries = phys_to_virt(child);
+    for (uint32_t i = USER_SPACE_START / LARGE_PAGE_SIZE; i < KERNEL_VIRT_BASE / LARGE_PAGE_SIZE; i++)
+    {
+        if (entries[i].valid)
+        {
+            entries[i].write_access = 0;
+            child_entries[i] = entries[i];
+            get_page(entries[i].page_table * PAGE_SIZE);
+        }
+    }
+    flush_user_tlb(directory);
+}
+
+/**
+ * @brief Drops the references a page table entry holds, on its anonymous page or its swap slot.
+ */
+static void put_entry(page_entry_t *entry, uint32_t table, uint32_t index)
+{
+    if (entry->valid && entry->anon)
+    {
+        rmap_remove(entry->physical_page * PAGE_SIZE, table, index);
+        put_page(entry->physical_page * PAGE_SIZE);
+    }
+    else if (IS_SWAP_ENTRY(*entry))
+    {
+        swap_free(entry->physical_page);
+    }
+}
+
+/**
+ * @brief Gives a page directory its own copy of the shared page table mapping an address. The anonymous pages
+ * it maps get one more reference and become read only in both tables, to be copied on write.
+ * If the page table is not shared anymore, it just gets its write access back.
+ *
+ * @return 0 on success, -1 if no memory is left for the copy.
+ */
+int unshare_user_page_table(uint32_t directory, uint32_t virt_addr)
+{
+    directory_entry_t *directory_entry = &((directory_entry_t *)phys_to_virt(directory))[virt_addr / LARGE_PAGE_SIZE];
+    if (!directory_entry->valid || directory_entry->write_access)
+    {
+        return 0;
+    }
+
+    uint32_t table = directory_entry->page_table * PAGE_SIZE;
+    if (addr_to_frame(table)->refcount > 1)
+    {
+        uint32_t copy;
+        page_entry_t *copy_entries = allocate_page_table(&copy);
+        if (copy_entries == NULL)
+        {
+            return -1;
+        }
+        page_entry_t *entries = phys_to_virt(table);
+        for (uint32_t i = 0; i < NUM_ENTRIES; i++)
+        {
+            if (entries[i].valid && entries[i].anon)
+            {
+                if (rmap_add(entries[i].physical_page * PAGE_SIZE, copy, i) != 0)
+                {
+                    for (uint32_t j = 0; j < i; j++)
+                    {
+                        put_entry(&copy_entries[j], copy, j);
+                    }
+                    free_page(copy);
+                    return -1;
+                }
+                entries[i].write_access = 0;
+                get_page(entries[i].physical_page * PAGE_SIZE);
+            }
+            else if (IS_SWAP_ENTRY(entries[i]))
+            {
+                swap_dup(entries[i].physical_page);
+            }
+            copy_entries[i] = entries[i];
+        }
+        put_page(table);
+        directory_entry->page_table = ADDR_TO_PAGE(copy);
+    }
+    directory_entry->write_access = 1;
+    flush_user_tlb(directory);
+    return 0;
+}
+
+/**
+ * @brief Drops the user page tables of a page directory, putting the anonymous pages and swap slots
+ * of the tables it was the last user of.
+ */
+void put_user_page_tables(uint32_t directory)
+{
+    directory_entry_t *entries = phys_to_virt(directory);
+    for (uint32_t i = USER_SPACE_START / LARGE_PAGE_SIZE; i < KERNEL_VIRT_BASE / LARGE_PAGE_SIZE; i++)
+    {
+        if (!entries[i].valid)
+        {
+            continue;
+        }
+
+        uint32_t table = entries[i].page_table * PAGE_SIZE;
+        if (addr_to_frame(table)->refcount == 1)
+        {
+            page_entry_t *page_table = phys_to_virt(table);
+            for (uint32_t j = 0; j < NUM_ENTRIES; j++)
+            {
+                put_entry(&page_table[j], table, j);
+            }
+        }
+        put_page(table);
+        *(uint32_t *)&entries[i] = 0;
+    }
+    flush_user_tlb(directory);
+}
+
+/**
+ * @brief Tests and clears the accessed bit of every entry mapping an anonymous page.
+ * The caller flushes the TLB so that the next accesses set the bits again.
+ * @return 1 if the page was accessed since the last call.
+ */
+uint8_t page_referenced(uint32_t page)
+{
+    uint8_t referenced = 0;
+    for (rmap_t *rmap = rmap_first(page); rmap != NULL; rmap = rmap->next)
+    {
+        page_entry_t *entry = &((page_entry_t *)phys_to_virt(rmap->table))[rmap->index];
+        referenced |= entry->read;
+        entry->read = 0;
+    }
+    return referenced;
+}
+
+/**
+ * @brief Tells if an anonymous page was written through any of its mappings.
+ */
+uint8_t page_dirty(uint32_t page)
+{
+    for (rmap_t *rmap = rmap_first(page); rmap != NULL; rmap = rmap->next)
+    {
+        if (((page_entry_t *)phys_to_virt(rmap->table))[rmap->index].dirty)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes an anonymous page from every page table mapping it, which frees it. Each entry keeps
+ * a reference on the swap slot holding the page, or is cleared to be zero filled again if slot is SWAP_NONE.
+ *
+ * @param slot Swap slot holding one reference for the first entry.
+ */
+void try_to_unmap(uint32_t page, uint32_t slot)
+{
+    uint8_t first = 1;
+    rmap_t *rmap;
+    while ((rmap = rmap_first(page)) != NULL)
+    {
+        uint32_t table = rmap->table;
+        uint32_t index = rmap->index;
+        page_entry_t *entry = &((page_entry_t *)phys_to_virt(table))[index];
+        if (slot != SWAP_NONE && !first)
+        {
+            swap_dup(slot);
+        }
+        *(uint32_t *)entry = slot != SWAP_NONE ? (slot << 12) | SWAP_ENTRY : 0;
+        first = 0;
+
+        rmap_remove(page, table, index);
+        put_page(page);
+    }
+}
+
+static void tlb_batch_add(tlb_batch_t *batch, uint32_t virt_addr, uint8_t global)
+{
+    if (batch->nb_addrs < INVLPG_MAX)
+    {
+        batch->addrs[batch->nb_addrs] = virt_addr;
+    }
+    batch->nb_addrs++;
+    batch->global |= global;
+}
+
+/**
+ * @brief Invalidates the changed pages one by one when they are few, or the whole TLB at once.
+ */
+static void tlb_batch_flush(tlb_batch_t *batch)
+{
+    if (batch->nb_addrs <= INVLPG_MAX)
+    {
+        for (uint32_t i = 0; i < batch->nb_addrs; i++)
+        {
+            invlpg(batch->addrs[i]);
+        }
+        nb_invlpg += batch->nb_addrs;
+        return;
+    }
+
+    if (batch->global)
+    {
+        flush_tlb_all();
+    }
+    else
+    {
+        write_cr3(read_cr3());
+    }
+    nb_full_flushes++;
+}
+
+/**
+ * @brief Maps pages in the current address space through its recursive entry, flushing the replaced
+ * mappings once at the end. Kernel addresses must be in the kernel window, whose page tables every address
+ * space shares; user addresses must not be in a page table shared by a clone.
+ *
+ * @param flags MAP_WRITE, MAP_USER, MAP_GLOBAL and MAP_ANON.
+ * @return 0 on success, -1 if a page table cannot be created, in which case the pages before it stay mapped.
+ */
+int vmm_map(uint32_t virt_addr, uint32_t phys_addr, uint32_t nb_pages, uint32_t flags, mem_type_t type)
+{
+    tlb_batch_t batch = {0};
+    int res = 0;
+    uint32_t irq_flags = irq_save();
+    for (uint32_t i = 0; i < nb_pages; i++)
+    {
+        uint32_t page = virt_addr + i * PAGE_SIZE;
+        directory_entry_t *directory_entry = &CURRENT_DIRECTORY[page / LARGE_PAGE_SIZE];
+        if (directory_entry->valid && directory_entry->size)
+        {
+            res = -1;
+            break;
+        }
+        if (!directory_entry->valid)
+        {
+            uint32_t table = page < KERNEL_VIRT_BASE ? alloc_zeroed_page() : 0;
+            if (table == 0)
+            {
+                res = -1;
+                break;
+            }
+            directory_entry->valid = 1;
+            directory_entry->write_access = 1;
+            directory_entry->access_mode = (flags & MAP_USER) != 0;
+            directory_entry->page_table = ADDR_TO_PAGE(table);
+            invlpg((uint32_t)&CURRENT_PAGE_TABLES[ADDR_TO_PAGE(page) & ~(NUM_ENTRIES - 1)]);
+        }
+
+        page_entry_t *entry = &CURRENT_PAGE_TABLES[ADDR_TO_PAGE(page)];
+        if (entry->valid)
+        {
+            tlb_batch_add(&batch, page, entry->global);
+        }
+        set_page_entry(entry, phys_addr + i * PAGE_SIZE, flags, type);
+    }
+    tlb_batch_flush(&batch);
+    irq_restore(irq_flags);
+    return res;
+}
+
+/**
+ * @brief Unmaps pages of the current address space, flushing them once at the end. The frames are left to the caller.
+ */
+void vmm_unmap(uint32_t virt_addr, uint32_t nb_pages)
+{
+    tlb_batch_t batch = {0};
+    uint32_t irq_flags = irq_save();
+    for (uint32_t i = 0; i < nb_pages; i++)
+    {
+        uint32_t page = virt_addr + i * PAGE_SIZE;
+        directory_entry_t *directory_entry = &CURRENT_DIRECTORY[page / LARGE_PAGE_SIZE];
+        if (!directory_entry->valid || directory_entry->size)
+        {
+            continue;
+        }
+
+        page_entry_t *entry = &CURRENT_PAGE_TABLES[ADDR_TO_PAGE(page)];
+        if (entry->valid)
+        {
+            tlb_batch_add(&batch, page, entry->global);
+            *(uint32_t *)entry = 0;
+        }
+    }
+    tlb_batch_flush(&batch);
+    irq_restore(irq_flags);
+}
+
+/**
+ * @brief Maps a device range in the kernel window, shared by every address space. The window is never given back.
+ * @return the kernel address of phys_addr, NULL when the window is full.
+ */
+void *ioremap(uint32_t phys_addr, uint32_t size, mem_type_t type)
+{
+    static uint32_t next_virt_addr = VMALLOC_START;
+    uint32_t offset = phys_addr & (PAGE_SIZE - 1);
+    uint32_t nb_pages = PAGE_ALIGN_UP(size + offset) / PAGE_SIZE;
+    if (nb_pages > (KMAP_BASE - next_virt_addr) / PAGE_SIZE)
+    {
+        return NULL;
+    }
+
+    uint32_t virt_addr = next_virt_addr;
+    if (vmm_map(virt_addr, phys_addr - offset, nb_pages, MAP_WRITE | MAP_GLOBAL, type) != 0)
+    {
+        return NULL;
+    }
+    next_virt_addr += nb_pages * PAGE_SIZE;
+    return (void *)(virt_addr + offset);
+}
+
+void tlb_stats(void)
+{
+    printf("tlb: %d pages invalidated, %d full flushes\n", nb_invlpg, nb_full_flushes);
+}
+
+/**
+ * @brief Gets a kernel address for any physical page: the direct map below lowmem_end, a KMAP_BASE slot above.
+ * @return The address, NULL if every slot is taken.
+ */
+void *kmap(uint32_t phys_addr)
+{
+    if (phys_addr < lowmem_end)
+    {
+        return phys_to_virt(phys_addr);
+    }
+
+    uint32_t flags = irq_save();
+    for (uint32_t slot = 0; slot < KMAP_SLOTS; slot++)
+    {
+        if (!(kmap_used & (1u << slot)))
+        {
+            uint32_t virt_addr = KMAP_BASE + slot * PAGE_SIZE;
+            kmap_used |= 1u << slot;
+            vmm_map(virt_addr, phys_addr, 1, MAP_WRITE, MEM_WB);
+            irq_restore(flags);
+            return (void *)virt_addr;
+        }
+    }
+    irq_restore(flags);
+    return NULL;
+}
+
+void kunmap(void *virt_addr)
+{
+    uint32_t addr = (uint32_t)virt_addr;
+    if (addr < KMAP_BASE || addr >= KMAP_BASE + KMAP_SLOTS * PAGE_SIZE)
+    {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    vmm_unmap(addr, 1);
+    kmap_used &= ~(1u << ((addr - KMAP_BASE) / PAGE_SIZE));
+    irq_restore(flags);
+}
 
-    setup_identity_page_range(ADDR_TO_PAGE(0xB8000), ADDR_TO_PAGE((0xB8000 + (25 * 80))) + 1, KERNEL_MODE, RW_MODE);
+/**
+ * @brief Creates a page directory sharing the kernel page tables of kernel_directory.
+ * @return Its physical address, 0 if no page is left.
+ */
+uint32_t create_address_space(void)
+{
+    uint32_t directory = alloc_page();
+    if (directory == 0)
+    {
+        return 0;
+    }
+    directory_entry_t *entries = phys_to_virt(directory);
+    directory_entry_t *kernel_entries = phys_to_virt(kernel_directory);
+    for (uint32_t i = 0; i < NUM_ENTRIES; i++)
+    {
+        entries[i] = kernel_entries[i];
+    }
+    entries[RECURSIVE_INDEX].page_table = ADDR_TO_PAGE(directory);
+    return directory;
+}
 
-    SET_CR3(page_directory);
+void destroy_address_space(uint32_t directory)
+{
+    if (directory != kernel_directory)
+    {
+        free_page(directory);
+    }
+}
+
+/**
+ * @brief Loads a page directory. CR3 is only written when it changes, since every reload drops the non global TLB entries.
+ */
+void switch_address_space(uint32_t directory)
+{
+    if (read_cr3() != directory)
+    {
+        write_cr3(directory);
+    }
+}
+
+typedef struct
+{
+    uint32_t virt_addr;
+    uint32_t phys_addr;
+    uint32_t size;
+    uint8_t write;
+    uint8_t user;
+    uint8_t large;
+    uint8_t global;
+    mem_type_t type;
+} mapping_run_t;
+
+static void print_run(mapping_run_t *run)
+{
+    if (run->size != 0)
+    {
+        printf("%x-%x -> %x %s %s %s %s%s\n", run->virt_addr, run->virt_addr + run->size - 1, run->phys_addr,
+               mem_type_names[run->type], run->write ? "rw" : "ro", run->user ? "user" : "kernel", run->large ? "4M" : "4K",
+               run->global ? " global" : "");
+        run->size = 0;
+    }
+}
+
+/**
+ * @brief Extends the current run with a mapping, printing the run first if the mapping does not continue it.
+ */
+static void add_to_run(mapping_run_t *run, mapping_run_t *mapping)
+{
+    if (run->size != 0 && mapping->virt_addr == run->virt_addr + run->size && mapping->phys_addr == run->phys_addr + run->size &&
+        mapping->write == run->write && mapping->user == run->user && mapping->large == run->large && mapping->global == run->global &&
+        mapping->type == run->type)
+    {
+        run->size += mapping->size;
+        return;
+    }
+    print_run(run);
+    *run = *mapping;
+}
+
+/**
+ * @brief Prints every mapped range of the kernel page directory with its memory type,
+ * merging neighbouring pages that share their attributes.
+ */
+void mmu_dump(void)
+{
+    mapping_run_t run = {0};
+    for (uint32_t directory_index = 0; directory_index < RECURSIVE_INDEX; directory_index++)
+    {
+        directory_entry_t *directory = &page_directory[directory_index];
+        if (!directory->valid)
+        {
+            print_run(&run);
+            continue;
+        }
+
+        if (directory->size)
+        {
+            mapping_run_t mapping = {directory_index * LARGE_PAGE_SIZE, (directory->page_table & ~1u) * PAGE_SIZE, LARGE_PAGE_SIZE,
+                                     directory->write_access, directory->access_mode, 1, directory->global,
+                                     entry_mem_type(directory->cache_defer, directory->cache_disabled, directory->page_table & 1)};
+            add_to_run(&run, &mapping);
+            continue;
+        }
+
+        page_entry_t *page_table = phys_to_virt(directory->page_table * PAGE_SIZE);
+        for (uint32_t i = 0; i < NUM_ENTRIES; i++)
+        {
+            page_entry_t *entry = &page_table[i];
+            if (!entry->valid)
+            {
+                print_run(&run);
+                continue;
+            }
+            mapping_run_t mapping = {directory_index * LARGE_PAGE_SIZE + i * PAGE_SIZE, entry->physical_page * PAGE_SIZE, PAGE_SIZE,
+                                     entry->write_access, entry->access_mode, 0, entry->global,
+                                     entry_mem_type(entry->cache_defer, entry->cache_disabled, entry->pat)};
+            add_to_run(&run, &mapping);
+        }
+    }
+    print_run(&run);
+    printf("%x-%x page tables\n", PAGE_TABLES_BASE, 0xFFFFFFFF);
 }
 
 void enable_mmu(void)
 {
     MMU_ENABLE();
+    direct_map_offset = KERNEL_VIRT_BASE;
 }
 
 void disable_mmu(void)
 {
+    direct_map_offset = 0;
     MMU_DISABLE();
 }
 
@@ -208,7 +1151,13 @@ void *get_cr2(void)
 void page_fault_handler(struct regs *r)
 {
     void *cr2 = get_cr2();
-    printf("Memory fault at address : %x, instruction : %x, err : %x\n", cr2, r->eip, r->err_code);
+    if (mm_handle_fault(current_mm, (uint32_t)cr2, r->err_code) == 0)
+    {
+        return;
+    }
+    klog(KLOG_ERR, "Memory fault at address : %x, instruction : %x, err : %x\n", cr2, r->eip, r->err_code);
+    klog_flush();
+    console_sync();
     for (;;)
         ;
 }
\ No newline at end of file
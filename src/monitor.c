@@ -0,0 +1,87 @@
+#include "monitor.h"
+#include "uart.h"
+#include "console.h"
+#include "irqstats.h"
+#include "timer.h"
+#include "lib.h"
+
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+} monitor_command_t;
+
+static void help(void);
+
+static const monitor_command_t commands[] = {
+    {"help", help},
+    {"irqstats", irq_stats_dump},
+    {"irqreset", irq_stats_reset},
+    {"timers", timer_stats_dump},
+};
+
+#define NB_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static char line[MONITOR_LINE];
+static uint32_t line_len = 0;
+
+static void serial_puts(const char *str)
+{
+    console_write_to(CONSOLE_SERIAL, str, strlen(str));
+}
+
+static void help(void)
+{
+    serial_puts("commands:");
+    for (uint32_t i = 0; i < NB_COMMANDS; i++)
+    {
+        serial_puts(" ");
+        serial_puts(commands[i].name);
+    }
+    serial_puts("\n");
+}
+
+static void run_command(void)
+{
+    line[line_len] = '\0';
+    for (uint32_t i = 0; i < NB_COMMANDS; i++)
+    {
+        if (strcmp(line, commands[i].name) == 0)
+        {
+            commands[i].run();
+            return;
+        }
+    }
+    help();
+}
+
+/**
+ * @brief Runs the debug commands typed on the serial line, from the idle loop. The line is echoed back.
+ */
+void monitor_poll(void)
+{
+    int c;
+    while ((c = uart_getc()) >= 0)
+    {
+        if (c == '\r' || c == '\n')
+        {
+            if (line_len != 0)
+            {
+                serial_puts("\n");
+                run_command();
+                line_len = 0;
+            }
+        }
+        else if ((c == '\b' || c == 0x7F) && line_len != 0)
+        {
+            line_len--;
+            serial_puts("\b \b");
+        }
+        else if (c >= ' ' && c < 0x7F && line_len < MONITOR_LINE - 1)
+        {
+            char echo = c;
+            line[line_len++] = echo;
+            console_write_to(CONSOLE_SERIAL, &echo, 1);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "reclaim.h"
+#include "buddy.h"
+#include "mmu.h"
+#include "swap.h"
+#include "rmap.h"
+#include "cpu.h"
+
+static uint32_t clock_hand = 0; // next frame the clock looks at
+static uint32_t nb_scanned = 0;
+static uint32_t nb_swapped = 0;
+static uint32_t nb_dropped = 0;
+
+typedef struct
+{
+    uint32_t page;
+    uint32_t slot;
+} victim_t;
+
+/**
+ * @brief Picks an anonymous page to evict: a zero filled page never written is dropped at once, any other one
+ * gets a swap slot and a reference keeping it until it is written out.
+ * @return 1 if the page was dropped, 0 if it became a victim, -1 if it has to stay.
+ */
+static int pick_page(uint32_t page, victim_t *victim)
+{
+    if ((addr_to_frame(page)->flags & FRAME_ZERO) && !page_dirty(page))
+    {
+        try_to_unmap(page, SWAP_NONE);
+        nb_dropped++;
+        return 1;
+    }
+
+    uint32_t slot = swap_alloc();
+    if (slot == SWAP_NONE)
+    {
+        return -1;
+    }
+    get_page(page);
+    *victim = (victim_t){.page = page, .slot = slot};
+    return 0;
+}
+
+/**
+ * @brief Frees cold anonymous user pages with the clock algorithm: a page accessed since the hand last passed
+ * gets a second chance and its accessed bits cleared, the others are evicted. The hand scans at most
+ * RECLAIM_SCAN_MAX frames with the interrupts disabled, then the interrupts are enabled while the victims
+ * are written to swap. Each one is only unmapped once written, unless it was accessed meanwhile.
+ * @return The number of pages freed, at most RECLAIM_BATCH.
+ */
+uint32_t reclaim_pages(uint32_t nb_pages)
+{
+    victim_t victims[RECLAIM_BATCH];
+    uint32_t nb_victims = 0;
+    uint32_t reclaimed = 0;
+    uint32_t max_scan = max_pfn < RECLAIM_SCAN_MAX / 2 ? 2 * max_pfn : RECLAIM_SCAN_MAX;
+    if (nb_pages > RECLAIM_BATCH)
+    {
+        nb_pages = RECLAIM_BATCH;
+    }
+
+    uint32_t flags = irq_save();
+    for (uint32_t scanned = 0; scanned < max_scan && reclaimed + nb_victims < nb_pages; scanned++)
+    {
+        uint32_t page = clock_hand * PAGE_SIZE;
+        clock_hand = (clock_hand + 1) % max_pfn;
+        nb_scanned++;
+
+        if (!(addr_to_frame(page)->flags & FRAME_ANON) || page_referenced(page))
+        {
+            continue;
+        }
+        int res = pick_page(page, &victims[nb_victims]);
+        if (res > 0)
+        {
+            reclaimed++;
+        }
+        else if (res == 0)
+        {
+            nb_victims++;
+        }
+    }
+    // the cleared accessed bits and the removed entries may still be in the TLB
+    write_cr3(read_cr3());
+
+    // the page fault handler runs with the interrupts disabled, the references hold the victims meanwhile
+    __asm__ volatile("sti");
+    for (uint32_t i = 0; i < nb_victims; i++)
+    {
+        int res = swap_write(victims[i].slot, victims[i].page);
+
+        // a page without mappings left or accessed during the write stays, its slot is not needed
+        __asm__ volatile("cli");
+        if (res != 0 || rmap_first(victims[i].page) == NULL || page_referenced(victims[i].page))
+        {
+            swap_free(victims[i].slot);
+        }
+        else
+        {
+            try_to_unmap(victims[i].page, victims[i].slot);
+            nb_swapped++;
+            reclaimed++;
+        }
+        put_page(victims[i].page);
+        __asm__ volatile("sti");
+    }
+    if (nb_victims != 0)
+    {
+        write_cr3(read_cr3());
+    }
+    irq_restore(flags);
+    return reclaimed;
+}
+
+void reclaim_stats(void)
+{
+    printf("reclaim: %d frames scanned, %d pages swapped out, %d zero pages dropped\n", nb_scanned, nb_swapped, nb_dropped);
+}
\ No newline at end of file
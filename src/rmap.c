@@ -0,0 +1,71 @@
+#include "rmap.h"
+#include "buddy.h"
+#include "slab.h"
+#include "cpu.h"
+
+static kmem_cache_t *rmap_cache;
+
+void init_rmap(void)
+{
+    rmap_cache = kmem_cache_create("rmap", sizeof(rmap_t), 0);
+}
+
+/**
+ * @brief Records that a page table entry maps an anonymous page.
+ * @return 0 on success, -1 if there is no memory left for the record.
+ */
+int rmap_add(uint32_t page, uint32_t table, uint32_t index)
+{
+    rmap_t *rmap = kmem_cache_alloc(rmap_cache);
+    if (rmap == NULL)
+    {
+        return -1;
+    }
+    rmap->table = table;
+    rmap->index = index;
+
+    uint32_t flags = irq_save();
+    frame_t *frame = addr_to_frame(page);
+    rmap->next = (frame->flags & FRAME_ANON) ? frame->rmap : NULL;
+    frame->rmap = rmap;
+    frame->flags |= FRAME_ANON;
+    irq_restore(flags);
+    return 0;
+}
+
+void rmap_remove(uint32_t page, uint32_t table, uint32_t index)
+{
+    uint32_t flags = irq_save();
+    frame_t *frame = addr_to_frame(page);
+    if (!(frame->flags & FRAME_ANON))
+    {
+        irq_restore(flags);
+        return;
+    }
+
+    rmap_t **link = (rmap_t **)&frame->rmap;
+    while (*link != NULL && ((*link)->table != table || (*link)->index != index))
+    {
+        link = &(*link)->next;
+    }
+    rmap_t *rmap = *link;
+    if (rmap != NULL)
+    {
+        *link = rmap->next;
+    }
+    if (frame->rmap == NULL)
+    {
+        frame->flags &= ~FRAME_ANON;
+    }
+    irq_restore(flags);
+    kmem_cache_free(rmap_cache, rmap);
+}
+
+/**
+ * @brief Gets the first entry mapping a page, NULL if it is not an anonymous page.
+ */
+rmap_t *rmap_first(uint32_t page)
+{
+    frame_t *frame = addr_to_frame(page);
+    return (frame->flags & FRAME_ANON) ? frame->rmap : NULL;
+}
\ No newline at end of file
@@ -1,40 +1,126 @@
 #include "screen.h"
+#include "lib.h"
+
+#define VGA_ROWS (SCREEN_MEMORY_SIZE / sizeof(uint16_t) / SCREEN_WIDTH) // rows of text memory the CRTC can start from
+#define ROW_SIZE (SCREEN_WIDTH * sizeof(uint16_t))
+#define BLANK (0x0F << 8 | ' ')
+
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW 0x0F
 
 static uint16_t cursor_x = 0;
 static uint16_t cursor_y = 0;
 
+/*
+ * The screen is a window of SCREEN_HEIGHT rows over the text memory starting at top_row,
+ * scrolling moves the CRTC start address down one row instead of copying the screen,
+ * the rows are only copied back to the start of the memory once the window reaches its end.
+ * A copy of the screen is kept in RAM since reads from the write combined text memory are uncached.
+ */
+static uint16_t top_row = 0;
+static uint16_t start_row = 0; // row programmed in the CRTC
+static uint16_t shadow[SCREEN_HEIGHT][SCREEN_WIDTH];
+static uint16_t shadow_first = 0; // shadow row of the first line of the screen
+
+static uint16_t scrollback[SCROLLBACK_LINES][SCREEN_WIDTH];
+static uint32_t nb_scrollback_lines = 0; // every line that left the screen, the last SCROLLBACK_LINES are kept
+static uint16_t view_offset = 0;         // lines scrolled back, 0 shows the screen
+
 uint16_t get_color(uint8_t fg, uint8_t bg)
 {
     return fg << 8 | bg;
 }
 
+static uint16_t *vga_row(uint32_t row)
+{
+    return SCREEN + row * SCREEN_WIDTH;
+}
+
+static uint16_t *shadow_line(uint32_t y)
+{
+    return shadow[(shadow_first + y) % SCREEN_HEIGHT];
+}
+
 void enable_cursor(void)
 {
-    outb(0x3D4, 0x0A);
-    outb(0x3D5, (inb(0x3D5) & 0xC0) | CURSOR_START);
-    outb(0x3D4, 0x0B);
-    outb(0x3D5, (inb(0x3D5) & 0xE0) | CURSOR_END);
+    outb(CRTC_INDEX, 0x0A);
+    outb(CRTC_DATA, (inb(CRTC_DATA) & 0xC0) | CURSOR_START);
+    outb(CRTC_INDEX, 0x0B);
+    outb(CRTC_DATA, (inb(CRTC_DATA) & 0xE0) | CURSOR_END);
 }
 
 void disable_cursor(void)
 {
-    outb(0x3D4, 0x0A);
-    outb(0x3D5, 0x20);
+    outb(CRTC_INDEX, 0x0A);
+    outb(CRTC_DATA, 0x20);
+}
+
+static void set_start_row(uint16_t row)
+{
+    if (row == start_row)
+    {
+        return;
+    }
+    uint16_t pos = row * SCREEN_WIDTH;
+    outb(CRTC_INDEX, CRTC_START_LOW);
+    outb(CRTC_DATA, (uint8_t)(pos & 0xFF));
+    outb(CRTC_INDEX, CRTC_START_HIGH);
+    outb(CRTC_DATA, (uint8_t)((pos >> 8) & 0xFF));
+    start_row = row;
 }
 
 void update_cursor()
 {
-    uint16_t pos = cursor_x + cursor_y * SCREEN_WIDTH;
-    outb(0x3D4, 0x0F);
-    outb(0x3D5, (uint8_t)(pos & 0xFF));
-    outb(0x3D4, 0x0E);
-    outb(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
+    uint16_t pos = cursor_x + (top_row + cursor_y) * SCREEN_WIDTH;
+    outb(CRTC_INDEX, CRTC_CURSOR_LOW);
+    outb(CRTC_DATA, (uint8_t)(pos & 0xFF));
+    outb(CRTC_INDEX, CRTC_CURSOR_HIGH);
+    outb(CRTC_DATA, (uint8_t)((pos >> 8) & 0xFF));
 }
 
 void screen_putc(char c, int x, int y, uint8_t color)
 {
-    uint16_t pos = x + y * SCREEN_WIDTH;
-    SCREEN[pos] = (color << 8) | c;
+    uint16_t cell = (color << 8) | (uint8_t)c;
+    shadow_line(y)[x] = cell;
+    vga_row(top_row + y)[x] = cell;
+}
+
+static void clear_line(uint32_t y)
+{
+    uint16_t *line = shadow_line(y);
+    for (size_t x = 0; x < SCREEN_WIDTH; x++)
+    {
+        line[x] = BLANK;
+    }
+    memcpy(vga_row(top_row + y), line, ROW_SIZE);
+}
+
+/**
+ * @brief Moves the screen one line down, its first line goes to the scrollback.
+ */
+static void scroll_line(void)
+{
+    memcpy(scrollback[nb_scrollback_lines % SCROLLBACK_LINES], shadow_line(0), ROW_SIZE);
+    nb_scrollback_lines++;
+
+    shadow_first = (shadow_first + 1) % SCREEN_HEIGHT;
+    if (top_row + SCREEN_HEIGHT == VGA_ROWS)
+    {
+        for (uint32_t y = 0; y < SCREEN_HEIGHT - 1; y++)
+        {
+            memcpy(vga_row(y), shadow_line(y), ROW_SIZE);
+        }
+        top_row = 0;
+    }
+    else
+    {
+        top_row++;
+    }
+    clear_line(SCREEN_HEIGHT - 1);
 }
 
 void init_screen(void)
@@ -45,19 +131,22 @@ void init_screen(void)
 
 void clear_screen(void)
 {
+    top_row = 0;
+    view_offset = 0;
     for (size_t y = 0; y < SCREEN_HEIGHT; y++)
     {
-        for (size_t x = 0; x < SCREEN_WIDTH; x++)
-        {
-            screen_putc(' ', x, y, 0xF);
-        }
+        clear_line(y);
     }
     cursor_x = 0;
     cursor_y = 0;
+    set_start_row(top_row);
     update_cursor();
 }
 
-void putchar(char c)
+/**
+ * @brief Draws a character and moves the cursor position, leaving the hardware registers to the caller.
+ */
+static void screen_emit(char c)
 {
     switch (c)
     {
@@ -69,10 +158,12 @@ void putchar(char c)
 
     case '\b':
     {
-        cursor_x--;
-        screen_putc(' ', cursor_x, cursor_y, 0x0F);
-        cursor_x--;
-        break;
+        if (cursor_x > 0)
+        {
+            cursor_x--;
+            screen_putc(' ', cursor_x, cursor_y, 0x0F);
+        }
+        return;
     }
 
     default:
@@ -85,8 +176,53 @@ void putchar(char c)
         cursor_x = 0;
         if (++cursor_y == SCREEN_HEIGHT)
         {
-            clear_screen();
+            scroll_line();
+            cursor_y = SCREEN_HEIGHT - 1;
         }
     }
+}
+
+void putchar(char c)
+{
+    screen_write(&c, 1);
+}
+
+/**
+ * @brief Draws len characters then programs the start address and the cursor once, the port writes cost more than the drawing.
+ * Any output brings a scrolled back view back to the screen.
+ */
+void screen_write(const char *buffer, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        screen_emit(buffer[i]);
+    }
+    view_offset = 0;
+    set_start_row(top_row);
     update_cursor();
+}
+
+/**
+ * @brief Scrolls the view back (lines > 0) or forward through the scrollback. The view is drawn in rows
+ * of the text memory outside of the screen, which is left untouched for when the view comes back to it.
+ */
+void screen_scroll(int lines)
+{
+    int max_offset = nb_scrollback_lines < SCROLLBACK_LINES ? nb_scrollback_lines : SCROLLBACK_LINES;
+    int offset = view_offset + lines;
+    view_offset = offset < 0 ? 0 : offset > max_offset ? max_offset : offset;
+    if (view_offset == 0)
+    {
+        set_start_row(top_row);
+        return;
+    }
+
+    uint16_t view_row = top_row >= SCREEN_HEIGHT ? 0 : top_row + SCREEN_HEIGHT;
+    for (int y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        int line = y - view_offset; // negative lines are in the scrollback, -1 the last one
+        const uint16_t *src = line >= 0 ? shadow_line(line) : scrollback[(nb_scrollback_lines + line) % SCROLLBACK_LINES];
+        memcpy(vga_row(view_row + y), src, ROW_SIZE);
+    }
+    set_start_row(view_row);
 }
\ No newline at end of file
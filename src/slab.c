@@ -0,0 +1,323 @@
+#include "slab.h"
+#include "buddy.h"
+#include "mmu.h"
+#include "cpu.h"
+
+#define SLAB_MAX_ORDER 3
+#define MIN_OBJECT_SIZE sizeof(void *)
+#define MAX_EMPTY_SLABS 1 // empty slabs kept per cache before going back to the buddy
+
+#define ALIGN_UP(value, align) (((value) + (align) - 1) & ~((align) - 1))
+
+static kmem_cache_t cache_cache; // the cache kmem_cache_create() takes its caches from
+static kmem_cache_t *caches = NULL;
+static kmem_cache_t *kmalloc_caches[KMALLOC_NB_CACHES];
+static uint32_t kmalloc_large_pages = 0;
+
+static const char *kmalloc_names[KMALLOC_NB_CACHES] = {
+    "kmalloc-8",
+    "kmalloc-16",
+    "kmalloc-32",
+    "kmalloc-64",
+    "kmalloc-128",
+    "kmalloc-256",
+    "kmalloc-512",
+    "kmalloc-1024",
+    "kmalloc-2048",
+};
+
+static void slab_list_add(slab_t **list, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+    {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static void slab_list_remove(slab_t **list, slab_t *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *list = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+}
+
+/**
+ * @brief Fills a cache descriptor, picking the smallest slab order that wastes at most 1/8 of the slab.
+ */
+static void cache_setup(kmem_cache_t *cache, const char *name, size_t size, size_t align)
+{
+    if (align < MIN_OBJECT_SIZE)
+    {
+        align = MIN_OBJECT_SIZE;
+    }
+    if (size < MIN_OBJECT_SIZE)
+    {
+        size = MIN_OBJECT_SIZE;
+    }
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+    cache->name = name;
+    cache->object_size = ALIGN_UP(size, align);
+    cache->objects_offset = ALIGN_UP(sizeof(slab_t), align);
+
+    for (cache->order = 0; cache->order < SLAB_MAX_ORDER; cache->order++)
+    {
+        uint32_t slab_size = PAGE_SIZE << cache->order;
+        uint32_t objects = (slab_size - cache->objects_offset) / cache->object_size;
+        if (objects > 0 && slab_size - objects * cache->object_size <= slab_size / 8)
+        {
+            break;
+        }
+    }
+    cache->objects_per_slab = ((PAGE_SIZE << cache->order) - cache->objects_offset) / cache->object_size;
+
+    cache->next = caches;
+    caches = cache;
+}
+
+static slab_t *cache_grow(kmem_cache_t *cache)
+{
+    uint32_t pages = alloc_pages(cache->order);
+    if (pages == 0)
+    {
+        return NULL;
+    }
+
+    slab_t *slab = phys_to_virt(pages);
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_objects = NULL;
+
+    uint8_t *objects = (uint8_t *)slab + cache->objects_offset;
+    for (uint32_t i = cache->objects_per_slab; i > 0; i--)
+    {
+        void **object = (void **)(objects + (i - 1) * cache->object_size);
+        *object = slab->free_objects;
+        slab->free_objects = object;
+    }
+
+    for (uint32_t i = 0; i < (1u << cache->order); i++)
+    {
+        frame_t *frame = addr_to_frame(pages + i * PAGE_SIZE);
+        frame->flags |= FRAME_SLAB;
+        frame->slab = slab;
+    }
+    cache->nb_slabs++;
+    return slab;
+}
+
+static void cache_release(kmem_cache_t *cache, slab_t *slab)
+{
+    cache->nb_slabs--;
+    free_pages(virt_to_phys(slab), cache->order);
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align)
+{
+    if (size == 0 || size > (PAGE_SIZE << SLAB_MAX_ORDER) / 2 || (align & (align - 1)) != 0)
+    {
+        return NULL;
+    }
+
+    kmem_cache_t *cache = kmem_cache_alloc(&cache_cache);
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t flags = irq_save();
+    cache_setup(cache, name, size, align);
+    irq_restore(flags);
+    return cache;
+}
+
+/**
+ * @brief Takes an object from the first partial slab, falling back on an empty one and then on a new slab.
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+    uint32_t flags = irq_save();
+    slab_t *slab = cache->partial;
+    if (slab == NULL)
+    {
+        slab = cache->empty;
+        if (slab != NULL)
+        {
+            slab_list_remove(&cache->empty, slab);
+            cache->nb_empty--;
+        }
+        else
+        {
+            slab = cache_grow(cache);
+            if (slab == NULL)
+            {
+                cache->nb_failures++;
+                irq_restore(flags);
+                return NULL;
+            }
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    void **object = slab->free_objects;
+    slab->free_objects = *object;
+    slab->in_use++;
+    if (slab->in_use == cache->objects_per_slab)
+    {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_add(&cache->full, slab);
+    }
+
+    cache->active_objects++;
+    cache->nb_allocs++;
+    irq_restore(flags);
+    return object;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *object)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    slab_t *slab = addr_to_frame(virt_to_phys(object))->slab;
+    *(void **)object = slab->free_objects;
+    slab->free_objects = object;
+
+    if (slab->in_use == cache->objects_per_slab)
+    {
+        slab_list_remove(&cache->full, slab);
+        slab_list_add(&cache->partial, slab);
+    }
+    slab->in_use--;
+    if (slab->in_use == 0)
+    {
+        slab_list_remove(&cache->partial, slab);
+        if (cache->nb_empty < MAX_EMPTY_SLABS)
+        {
+            slab_list_add(&cache->empty, slab);
+            cache->nb_empty++;
+        }
+        else
+        {
+            cache_release(cache, slab);
+        }
+    }
+
+    cache->active_objects--;
+    cache->nb_frees++;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Gives the empty slabs of a cache back to the buddy allocator.
+ */
+void kmem_cache_shrink(kmem_cache_t *cache)
+{
+    uint32_t flags = irq_save();
+    while (cache->empty != NULL)
+    {
+        slab_t *slab = cache->empty;
+        slab_list_remove(&cache->empty, slab);
+        cache_release(cache, slab);
+    }
+    cache->nb_empty = 0;
+    irq_restore(flags);
+}
+
+void init_slab(void)
+{
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 0);
+    for (int i = 0; i < KMALLOC_NB_CACHES; i++)
+    {
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], 1 << (i + KMALLOC_MIN_SHIFT), 0);
+    }
+}
+
+/**
+ * @brief Allocates from the smallest power of two cache holding size, or whole pages past KMALLOC_MAX_SHIFT.
+ */
+void *kmalloc(size_t size)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    if (size > (1u << KMALLOC_MAX_SHIFT))
+    {
+        uint8_t order = 0;
+        while ((size_t)(PAGE_SIZE << order) < size)
+        {
+            order++;
+        }
+        uint32_t pages = alloc_pages(order);
+        if (pages == 0)
+        {
+            return NULL;
+        }
+        kmalloc_large_pages += 1 << order;
+        return phys_to_virt(pages);
+    }
+
+    int index = 0;
+    while ((1u << (index + KMALLOC_MIN_SHIFT)) < size)
+    {
+        index++;
+    }
+    return kmem_cache_alloc(kmalloc_caches[index]);
+}
+
+void kfree(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    uint32_t phys_addr = virt_to_phys(ptr);
+    frame_t *frame = addr_to_frame(phys_addr);
+    if (frame->flags & FRAME_SLAB)
+    {
+        slab_t *slab = frame->slab;
+        kmem_cache_free(slab->cache, ptr);
+    }
+    else
+    {
+        kmalloc_large_pages -= 1 << frame->order;
+        free_pages(phys_addr, frame->order);
+    }
+}
+
+/**
+ * @brief Prints the counters of every cache, overhead being the part of the slabs not holding live objects.
+ */
+void kmem_cache_stats(void)
+{
+    printf("cache size active/total slabs allocs frees fails overhead\n");
+    for (kmem_cache_t *cache = caches; cache != NULL; cache = cache->next)
+    {
+        uint32_t total = cache->nb_slabs * cache->objects_per_slab;
+        uint32_t slab_bytes = cache->nb_slabs * (PAGE_SIZE << cache->order);
+        uint32_t used_bytes = cache->active_objects * cache->object_size;
+        printf("%s %d %d/%d %d %d %d %d %d%%\n",
+               cache->name, cache->object_size, cache->active_objects, total, cache->nb_slabs,
+               cache->nb_allocs, cache->nb_frees, cache->nb_failures,
+               slab_bytes == 0 ? 0 : (slab_bytes - used_bytes) * 100 / slab_bytes);
+    }
+    printf("kmalloc pages %d\n", kmalloc_large_pages);
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "softirq.h"
+#include "cpu.h"
+
+typedef struct
+{
+    tasklet_t *head;
+    tasklet_t **tail;
+} tasklet_list_t;
+
+typedef struct
+{
+    uint8_t running; // an interrupt taken while the softirqs run leaves them to the running loop
+    tasklet_list_t tasklets;
+    tasklet_list_t hi_tasklets;
+} cpu_softirq_t;
+
+volatile uint32_t softirq_pending[MAX_CPUS];
+
+static void (*softirq_actions[NB_SOFTIRQS])(void);
+static cpu_softirq_t cpu_softirqs[MAX_CPUS];
+
+static inline uint32_t this_cpu(void)
+{
+    return 0;
+}
+
+/**
+ * @brief Runs the tasklets queued on a list with the interrupts enabled, the ones queued meanwhile wait
+ * for the next round.
+ */
+static void run_tasklets(tasklet_list_t *list)
+{
+    uint32_t flags = irq_save();
+    tasklet_t *tasklet = list->head;
+    list->head = NULL;
+    list->tail = &list->head;
+    irq_restore(flags);
+
+    while (tasklet != NULL)
+    {
+        tasklet_t *next = tasklet->next;
+        __atomic_and_fetch(&tasklet->state, ~TASKLET_SCHEDULED, __ATOMIC_RELEASE);
+        tasklet->func(tasklet->data);
+        tasklet = next;
+    }
+}
+
+static void tasklet_action(void)
+{
+    run_tasklets(&cpu_softirqs[this_cpu()].tasklets);
+}
+
+static void tasklet_hi_action(void)
+{
+    run_tasklets(&cpu_softirqs[this_cpu()].hi_tasklets);
+}
+
+void init_softirq(void)
+{
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++)
+    {
+        cpu_softirqs[cpu].tasklets.tail = &cpu_softirqs[cpu].tasklets.head;
+        cpu_softirqs[cpu].hi_tasklets.tail = &cpu_softirqs[cpu].hi_tasklets.head;
+    }
+    open_softirq(SOFTIRQ_HI, tasklet_hi_action);
+    open_softirq(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+void open_softirq(softirq_t nr, void (*action)(void))
+{
+    softirq_actions[nr] = action;
+}
+
+/**
+ * @brief Marks a softirq pending on this CPU, it runs on the next interrupt exit or in the idle loop.
+ */
+void raise_softirq(softirq_t nr)
+{
+    __atomic_or_fetch(&softirq_pending[this_cpu()], 1u << nr, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Runs the pending softirqs by priority with the interrupts enabled, called by irq_common after the end
+ * of interrupt and by the idle loop. After SOFTIRQ_MAX_RESTART rounds the rest is left to the idle loop,
+ * so a flood of interrupts cannot starve the interrupted code.
+ */
+void do_softirq(void)
+{
+    uint32_t flags = irq_save();
+    cpu_softirq_t *cpu = &cpu_softirqs[this_cpu()];
+    if (!cpu->running)
+    {
+        cpu->running = 1;
+        for (uint32_t restart = 0; restart < SOFTIRQ_MAX_RESTART && softirq_pending[this_cpu()] != 0; restart++)
+        {
+            uint32_t pending = softirq_pending[this_cpu()];
+            softirq_pending[this_cpu()] = 0;
+            __asm__ volatile("sti");
+            while (pending != 0)
+            {
+                uint32_t nr = __builtin_ctz(pending);
+                pending &= pending - 1;
+                if (softirq_actions[nr] != NULL)
+                {
+                    softirq_actions[nr]();
+                }
+            }
+            __asm__ volatile("cli");
+        }
+        cpu->running = 0;
+    }
+    irq_restore(flags);
+}
+
+static void queue_tasklet(tasklet_list_t *list, tasklet_t *tasklet, softirq_t nr)
+{
+    uint32_t flags = irq_save();
+    if (!(tasklet->state & TASKLET_SCHEDULED))
+    {
+        tasklet->state |= TASKLET_SCHEDULED;
+        tasklet->next = NULL;
+        *list->tail = tasklet;
+        list->tail = &tasklet->next;
+        raise_softirq(nr);
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief Queues a tasklet on this CPU unless it already waits to run.
+ */
+void tasklet_schedule(tasklet_t *tasklet)
+{
+    queue_tasklet(&cpu_softirqs[this_cpu()].tasklets, tasklet, SOFTIRQ_TASKLET);
+}
+
+void tasklet_hi_schedule(tasklet_t *tasklet)
+{
+    queue_tasklet(&cpu_softirqs[this_cpu()].hi_tasklets, tasklet, SOFTIRQ_HI);
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "swap.h"
+#include "ata.h"
+#include "mmu.h"
+#include "cpu.h"
+
+#define SECTORS_PER_SLOT (PAGE_SIZE / ATA_SECTOR_SIZE)
+
+static uint32_t swap_map[SWAP_MAX_SLOTS]; // page table entries referencing each slot, 0 when free, cannot wrap
+static uint32_t nb_slots = 0;
+static uint32_t nb_used = 0;
+static uint32_t next_slot = 0;
+static uint32_t nb_writes = 0;
+static uint32_t nb_reads = 0;
+
+/**
+ * @brief Uses the primary master disk as swap area, from its first sector.
+ */
+void init_swap(void)
+{
+    if (ata_init() != 0)
+    {
+        printf("swap: no disk\n");
+        return;
+    }
+    nb_slots = ata_sectors() / SECTORS_PER_SLOT;
+    if (nb_slots > SWAP_MAX_SLOTS)
+    {
+        nb_slots = SWAP_MAX_SLOTS;
+    }
+    printf("swap: %d KiB\n", nb_slots * (PAGE_SIZE / 1024));
+}
+
+/**
+ * @brief Takes a free slot with one reference, searching from the last allocated one.
+ * @return The slot, SWAP_NONE if the swap area is full.
+ */
+uint32_t swap_alloc(void)
+{
+    uint32_t flags = irq_save();
+    for (uint32_t i = 0; i < nb_slots; i++)
+    {
+        uint32_t slot = (next_slot + i) % nb_slots;
+        if (swap_map[slot] == 0)
+        {
+            swap_map[slot] = 1;
+            next_slot = slot + 1;
+            nb_used++;
+            irq_restore(flags);
+            return slot;
+        }
+    }
+    irq_restore(flags);
+    return SWAP_NONE;
+}
+
+void swap_dup(uint32_t slot)
+{
+    uint32_t flags = irq_save();
+    swap_map[slot]++;
+    irq_restore(flags);
+}
+
+void swap_free(uint32_t slot)
+{
+    uint32_t flags = irq_save();
+    if (--swap_map[slot] == 0)
+    {
+        nb_used--;
+    }
+    irq_restore(flags);
+}
+
+int swap_write(uint32_t slot, uint32_t page)
+{
+    void *addr = kmap(page);
+    if (addr == NULL)
+    {
+        return -1;
+    }
+    int res = ata_write(slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, addr);
+    kunmap(addr);
+    nb_writes++;
+    return res;
+}
+
+int swap_read(uint32_t slot, uint32_t page)
+{
+    void *addr = kmap(page);
+    if (addr == NULL)
+    {
+        return -1;
+    }
+    int res = ata_read(slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, addr);
+    kunmap(addr);
+    nb_reads++;
+    return res;
+}
+
+void swap_stats(void)
+{
+    printf("swap: %d/%d slots used, %d pages written, %d read\n", nb_used, nb_slots, nb_writes, nb_reads);
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "syscall.h"
+#include "vm.h"
+#include "lib.h"
+#include "idle.h"
+#include "klog.h"
+#include "console.h"
+#include "keyboard.h"
+#include "gdt.h"
+#include "cpu.h"
+#include "irqstats.h"
+#include "clock.h"
+#include "timer.h"
+
+typedef uint32_t (*syscall_t)(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+static uint8_t user_range_valid(uint32_t addr, uint32_t size)
+{
+    return addr >= USER_SPACE_START && addr + size >= addr && addr + size <= KERNEL_VIRT_BASE;
+}
+
+/**
+ * @brief Writes a user buffer on the console. Its pages are faulted in as they are read.
+ */
+static uint32_t sys_write(uint32_t buf, uint32_t size, uint32_t unused)
+{
+    (void)unused;
+    if (!user_range_valid(buf, size))
+    {
+        return (uint32_t)-1;
+    }
+    console_write((const char *)buf, size);
+    return size;
+}
+
+/**
+ * @brief Moves the program break, 0 only reads it.
+ */
+static uint32_t sys_brk(uint32_t brk, uint32_t unused1, uint32_t unused2)
+{
+    (void)unused1;
+    (void)unused2;
+    return brk == 0 ? current_mm->brk : mm_brk(current_mm, brk);
+}
+
+static uint32_t sys_pause(uint32_t unused1, uint32_t unused2, uint32_t unused3)
+{
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    idle_once();
+    return 0;
+}
+
+/**
+ * @brief Copies the kernel log as text lines into a user buffer, from the sequence number at seq_addr
+ * which is moved past the lines copied. Returns the number of bytes copied.
+ */
+static uint32_t sys_klog(uint32_t buf, uint32_t size, uint32_t seq_addr)
+{
+    if (!user_range_valid(buf, size) || !user_range_valid(seq_addr, sizeof(uint32_t)))
+    {
+        return (uint32_t)-1;
+    }
+    return klog_read((uint32_t *)seq_addr, (char *)buf, size, KLOG_DEBUG);
+}
+
+/**
+ * @brief Reads a line typed on the keyboard into a user buffer, idling until one is finished.
+ */
+static uint32_t sys_read(uint32_t fd, uint32_t buf, uint32_t size)
+{
+    if (fd != 0 || !user_range_valid(buf, size))
+    {
+        return (uint32_t)-1;
+    }
+    return keyboard_read((char *)buf, size);
+}
+
+/**
+ * @brief Copies the interrupt histograms of a vector into a user buffer of at least sizeof(irq_stats_t) bytes.
+ */
+static uint32_t sys_irq_stats(uint32_t vector, uint32_t buf, uint32_t size)
+{
+    if (size < sizeof(irq_stats_t) || !user_range_valid(buf, size))
+    {
+        return (uint32_t)-1;
+    }
+    return irq_stats_get(vector, (irq_stats_t *)buf);
+}
+
+static uint32_t sys_clock_gettime(uint32_t clock_id, uint32_t ts_addr, uint32_t unused)
+{
+    (void)unused;
+    if (clock_id != CLOCK_MONOTONIC || !user_range_valid(ts_addr, sizeof(timespec_t)))
+    {
+        return (uint32_t)-1;
+    }
+    uint64_t ns = ktime_get();
+    timespec_t *ts = (timespec_t *)ts_addr;
+    ts->tv_nsec = div64(&ns, NSEC_PER_SEC);
+    ts->tv_sec = (uint32_t)ns;
+    return 0;
+}
+
+/**
+ * @brief Idles for the delay in a user timespec_t, its tv_nsec below NSEC_PER_SEC.
+ */
+static uint32_t sys_nanosleep(uint32_t ts_addr, uint32_t unused1, uint32_t unused2)
+{
+    (void)unused1;
+    (void)unused2;
+    if (!user_range_valid(ts_addr, sizeof(timespec_t)))
+    {
+        return (uint32_t)-1;
+    }
+    timespec_t ts = *(timespec_t *)ts_addr;
+    if (ts.tv_nsec >= NSEC_PER_SEC)
+    {
+        return (uint32_t)-1;
+    }
+    timer_sleep((uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec);
+    return 0;
+}
+
+// also indexed by sysenter_entry
+syscall_t syscalls[NB_SYSCALLS] = {
+    [SYS_WRITE] = sys_write,
+    [SYS_BRK] = sys_brk,
+    [SYS_PAUSE] = sys_pause,
+    [SYS_KLOG] = sys_klog,
+    [SYS_READ] = sys_read,
+    [SYS_IRQ_STATS] = sys_irq_stats,
+    [SYS_CLOCK_GETTIME] = sys_clock_gettime,
+    [SYS_NANOSLEEP] = sys_nanosleep,
+};
+
+const uint32_t nb_syscalls = NB_SYSCALLS;
+
+/**
+ * @brief Points sysenter at sysenter_entry on the kernel stack, the one the TSS gives to int 0x80.
+ * int 0x80 stays the way in when the CPU has no sysenter.
+ */
+void init_sysenter(void)
+{
+    extern char _kernel_stack_top;
+    extern void sysenter_entry(void);
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_SEP))
+    {
+        klog(KLOG_INFO, "syscall: no sysenter, int 0x80 only\n");
+        return;
+    }
+
+    // sysexit goes back to the selectors 16 and 24 bytes above, the user code and data of the GDT
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CODE_SELECTOR);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&_kernel_stack_top);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+void syscall_handler(struct regs *r)
+{
+    if (r->eax >= NB_SYSCALLS || current_mm == NULL)
+    {
+        r->eax = (uint32_t)-1;
+        return;
+    }
+    r->eax = syscalls[r->eax](r->ebx, r->ecx, r->edx);
+}
\ No newline at end of file
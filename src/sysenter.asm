@@ -0,0 +1,25 @@
+extern syscalls
+extern nb_syscalls
+
+; sysenter lands here with interrupts off and esp at the top of the kernel stack.
+; eax holds the number, ebx, ecx and edx the arguments, esi the user stack and edi the return address.
+; The user segments are flat, ds and es are kept as they are.
+global sysenter_entry
+sysenter_entry:
+    push esi
+    push edi
+    cmp eax, [nb_syscalls]
+    jae .invalid
+    push edx
+    push ecx
+    push ebx
+    call dword [syscalls + eax * 4]
+    add esp, 12
+    jmp .exit
+.invalid:
+    mov eax, -1
+.exit:
+    pop edx        ; sysexit jumps to edx with the stack in ecx
+    pop ecx
+    sti            ; only takes effect after sysexit
+    sysexit
\ No newline at end of file
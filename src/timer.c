@@ -0,0 +1,423 @@
+#include "timer.h"
+#include "clock.h"
+#include "apic.h"
+#include "idt.h"
+#include "ioport.h"
+#include "softirq.h"
+#include "idle.h"
+#include "console.h"
+#include "klog.h"
+#include "cpu.h"
+#include "lib.h"
+
+#define TIMER_UNIT (1ULL << TIMER_SHIFT)
+#define LEVEL_MASK (TIMER_LEVEL_SIZE - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMER_LEVEL_BITS)
+#define WHEEL_MAX_DELTA ((1ULL << LEVEL_SHIFT(TIMER_LEVELS)) - 1) // units, later timers are cascaded until in range
+#define MIN_DELTA_NS 10000 // shorter events could pass while they are programmed
+#define NO_EVENT UINT64_MAX
+
+typedef enum
+{
+    TIMER_PERIODIC, // the PIT at HZ, one-shot delays need the TSC to be measured
+    TIMER_LAPIC,    // local APIC timer in one-shot mode
+    TIMER_PIT,      // PIT channel 0 in mode 0, without a local APIC
+} timer_mode_t;
+
+static const char *mode_names[] = {"periodic", "local APIC one-shot", "PIT one-shot"};
+
+static ktimer_t *wheel[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+static uint64_t pending[TIMER_LEVELS]; // bit n is set while slot n of the level holds timers
+static uint64_t wheel_clock = 0;       // next unit to run
+static uint32_t nb_timers = 0;
+static timer_mode_t mode = TIMER_PERIODIC;
+static uint64_t next_event = NO_EVENT; // ns the hardware fires at, one-shot modes only
+
+static uint32_t wakeups = 0;
+static uint32_t expired = 0;
+static uint64_t slack_total = 0; // ns between the expiry and the callback
+static uint32_t slack_max = 0;
+static uint32_t last_wakeups = 0;
+static uint64_t last_dump = 0;
+
+// __builtin_ctzll needs __ctzdi2 from libgcc on i386
+static uint32_t ctz64(uint64_t value)
+{
+    uint32_t low = (uint32_t)value;
+    return low != 0 ? (uint32_t)__builtin_ctz(low) : 32 + (uint32_t)__builtin_ctz((uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Links a timer in the slot of its expiry unit, on the lowest level whose range from the wheel clock
+ * covers it. Called with the interrupts disabled.
+ */
+static void enqueue(ktimer_t *timer)
+{
+    uint64_t unit = (timer->expires + TIMER_UNIT - 1) >> TIMER_SHIFT;
+    if (unit < wheel_clock)
+    {
+        unit = wheel_clock; // late, it runs with the next slot
+    }
+    uint64_t delta = unit - wheel_clock;
+    if (delta > WHEEL_MAX_DELTA)
+    {
+        delta = WHEEL_MAX_DELTA;
+        unit = wheel_clock + delta;
+    }
+
+    uint32_t level = 0;
+    while (level < TIMER_LEVELS - 1 && (delta >> LEVEL_SHIFT(level + 1)) != 0)
+    {
+        level++;
+    }
+    uint32_t slot = (unit >> LEVEL_SHIFT(level)) & LEVEL_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->next = wheel[level][slot];
+    if (timer->next != NULL)
+    {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = &wheel[level][slot];
+    wheel[level][slot] = timer;
+    pending[level] |= 1ULL << slot;
+}
+
+static void dequeue(ktimer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next != NULL)
+    {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = NULL;
+    if (wheel[timer->level][timer->slot] == NULL)
+    {
+        pending[timer->level] &= ~(1ULL << timer->slot);
+    }
+    nb_timers--;
+}
+
+/**
+ * @brief Spreads the timers of a slot over the lower levels once the wheel clock reaches its start.
+ */
+static void cascade(uint32_t level, uint32_t slot)
+{
+    ktimer_t *timer = wheel[level][slot];
+    wheel[level][slot] = NULL;
+    pending[level] &= ~(1ULL << slot);
+    while (timer != NULL)
+    {
+        ktimer_t *next = timer->next;
+        enqueue(timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief Finds the first unit with work: a level 0 slot to run or a higher slot to cascade.
+ * @return The unit, NO_EVENT with no timers.
+ */
+static uint64_t next_expiry(void)
+{
+    uint64_t next = NO_EVENT;
+    for (uint32_t level = 0; level < TIMER_LEVELS; level++)
+    {
+        if (pending[level] == 0)
+        {
+            continue;
+        }
+        // the slots of the level are reached in turn from the first one starting at or after the wheel clock
+        uint32_t shift = LEVEL_SHIFT(level);
+        uint64_t first = (wheel_clock + (1ULL << shift) - 1) >> shift;
+        uint32_t index = first & LEVEL_MASK;
+        uint64_t ahead = pending[level];
+        if (index != 0)
+        {
+            ahead = (ahead >> index) | (ahead << (TIMER_LEVEL_SIZE - index));
+        }
+        uint64_t unit = (first + ctz64(ahead)) << shift;
+        if (unit < next)
+        {
+            next = unit;
+        }
+    }
+    return next;
+}
+
+static void pit_stop(void)
+{
+    outb(PIT_COMMAND, PIT_CHANNEL0_ONE_SHOT); // mode 0 holds its output low until a count is written
+}
+
+static void pit_arm(uint64_t ns)
+{
+    if (ns > 0xFFFFFFFF)
+    {
+        ns = 0xFFFFFFFF;
+    }
+    uint64_t count = ns * PIT_FREQUENCY;
+    div64(&count, NSEC_PER_SEC);
+    if (count == 0)
+    {
+        count = 1;
+    }
+    else if (count > 0xFFFF)
+    {
+        count = 0xFFFF; // about 55 ms, longer delays take several wakeups
+    }
+    outb(PIT_COMMAND, PIT_CHANNEL0_ONE_SHOT);
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, count >> 8);
+}
+
+/**
+ * @brief Programs the one-shot hardware for the next expiry only, or stops it without timers.
+ * Called with the interrupts disabled.
+ */
+static void program_event(void)
+{
+    if (mode == TIMER_PERIODIC)
+    {
+        return;
+    }
+
+    uint64_t unit = next_expiry();
+    if (unit == NO_EVENT)
+    {
+        next_event = NO_EVENT;
+        if (mode == TIMER_LAPIC)
+        {
+            lapic_timer_arm(0);
+        }
+        else
+        {
+            pit_stop();
+        }
+        return;
+    }
+
+    next_event = unit << TIMER_SHIFT;
+    uint64_t now = ktime_get();
+    uint64_t delta = next_event > now + MIN_DELTA_NS ? next_event - now : MIN_DELTA_NS;
+    if (mode == TIMER_LAPIC)
+    {
+        lapic_timer_arm(delta);
+    }
+    else
+    {
+        pit_arm(delta);
+    }
+}
+
+static void timer_interrupt(void)
+{
+    wakeups++;
+    if (mode == TIMER_PERIODIC)
+    {
+        jiffies++;
+    }
+    raise_softirq(SOFTIRQ_TIMER);
+}
+
+/**
+ * @brief The SOFTIRQ_TIMER action: moves the wheel clock up to now, cascading the higher levels on their
+ * boundaries and running the expired callbacks with the interrupts enabled, then programs the next event.
+ */
+static void run_timers(void)
+{
+    uint32_t flags = irq_save();
+    uint64_t now = ktime_get() >> TIMER_SHIFT;
+    while (wheel_clock <= now)
+    {
+        if (nb_timers == 0)
+        {
+            wheel_clock = now + 1;
+            break;
+        }
+
+        // highest level first, so its timers reach the lower slots before those are cascaded
+        uint32_t top = 0;
+        while (top < TIMER_LEVELS - 1 && (wheel_clock & ((1ULL << LEVEL_SHIFT(top + 1)) - 1)) == 0)
+        {
+            top++;
+        }
+        for (uint32_t level = top; level > 0; level--)
+        {
+            cascade(level, (wheel_clock >> LEVEL_SHIFT(level)) & LEVEL_MASK);
+        }
+
+        // skip the empty slots up to the next one with timers or the next boundary
+        uint32_t index = wheel_clock & LEVEL_MASK;
+        uint64_t ahead = pending[0] >> index;
+        if (!(ahead & 1))
+        {
+            uint64_t skip_to = ahead != 0 ? wheel_clock + ctz64(ahead) : (wheel_clock | LEVEL_MASK) + 1;
+            wheel_clock = skip_to < now + 1 ? skip_to : now + 1;
+            continue;
+        }
+
+        ktimer_t *list = wheel[0][index];
+        wheel[0][index] = NULL;
+        pending[0] &= ~(1ULL << index);
+        list->pprev = &list;
+        wheel_clock++;
+        while (list != NULL)
+        {
+            ktimer_t *timer = list;
+            dequeue(timer);
+            uint64_t slack = ktime_get() - timer->expires;
+            slack_total += slack;
+            if (slack > slack_max)
+            {
+                slack_max = slack > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)slack;
+            }
+            expired++;
+
+            irq_restore(flags);
+            timer->func(timer->data);
+            flags = irq_save();
+        }
+    }
+    program_event();
+    irq_restore(flags);
+}
+
+/**
+ * @brief Takes over the PIT interrupt. With a TSC to measure the delays the periodic tick stops and the local
+ * APIC timer, or the PIT in mode 0 without one, is programmed for the next expiry only. Called with the
+ * interrupts disabled, after init_clock.
+ */
+void init_timer(void)
+{
+    wheel_clock = ktime_get() >> TIMER_SHIFT;
+    set_irq_handler(IRQ_BASE + PIT_IRQ, timer_interrupt);
+    open_softirq(SOFTIRQ_TIMER, run_timers);
+    last_dump = ktime_get();
+    if (tsc_khz == 0)
+    {
+        klog(KLOG_INFO, "timer: no TSC, periodic at %d Hz\n", HZ);
+        return;
+    }
+
+    // the local APIC timer raises the PIT vector, irq_common then ends it on the local APIC
+    uint32_t khz = lapic_timer_init(IRQ_BASE + PIT_IRQ);
+    pit_stop();
+    mode = khz != 0 ? TIMER_LAPIC : TIMER_PIT;
+    if (mode == TIMER_LAPIC)
+    {
+        klog(KLOG_INFO, "timer: %s at %u kHz\n", mode_names[mode], khz);
+    }
+    else
+    {
+        klog(KLOG_INFO, "timer: %s\n", mode_names[mode]);
+    }
+}
+
+void timer_setup(ktimer_t *timer, void (*func)(uint32_t data), uint32_t data)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->func = func;
+    timer->data = data;
+}
+
+/**
+ * @brief Queues a timer to run at expires, in ns since init_clock, moving it if it is already queued.
+ */
+void timer_add(ktimer_t *timer, uint64_t expires)
+{
+    uint32_t flags = irq_save();
+    if (timer_pending(timer))
+    {
+        dequeue(timer);
+    }
+    else if (nb_timers == 0)
+    {
+        // the wheel clock stands still while the wheel is empty, catch it up so the delta stays short
+        uint64_t now = ktime_get() >> TIMER_SHIFT;
+        if (now > wheel_clock)
+        {
+            wheel_clock = now;
+        }
+    }
+    timer->expires = expires;
+    enqueue(timer);
+    nb_timers++;
+    if (expires < next_event)
+    {
+        program_event();
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief Removes a queued timer. The hardware is left programmed, an early wakeup finds nothing to run.
+ * @return 1 if the timer was queued.
+ */
+int timer_cancel(ktimer_t *timer)
+{
+    uint32_t flags = irq_save();
+    int queued = timer_pending(timer);
+    if (queued)
+    {
+        dequeue(timer);
+    }
+    irq_restore(flags);
+    return queued;
+}
+
+static void sleep_wake_up(uint32_t data)
+{
+    wake_up((wait_queue_t *)data);
+}
+
+/**
+ * @brief Idles for at least ns nanoseconds.
+ */
+void timer_sleep(uint64_t ns)
+{
+    wait_queue_t queue = {.events = 0};
+    ktimer_t timer;
+    timer_setup(&timer, sleep_wake_up, (uint32_t)&queue);
+    timer_add(&timer, ktime_get() + ns);
+    wait_event(&queue, 0);
+}
+
+/**
+ * @brief Prints the timer wakeups, per second since the previous dump, and the slack between the expiries
+ * and their callbacks on the serial line.
+ */
+void timer_stats_dump(void)
+{
+    uint32_t flags = irq_save();
+    uint32_t queued = nb_timers;
+    uint32_t nb_wakeups = wakeups;
+    uint32_t nb_expired = expired;
+    uint64_t slack_avg = slack_total;
+    uint32_t slack_worst = slack_max;
+    irq_restore(flags);
+
+    uint64_t now = ktime_get();
+    uint64_t elapsed_ms = now - last_dump;
+    div64(&elapsed_ms, NSEC_PER_MSEC);
+    uint64_t rate = 0;
+    if (elapsed_ms != 0 && (elapsed_ms >> 32) == 0)
+    {
+        rate = (uint64_t)(nb_wakeups - last_wakeups) * 1000;
+        div64(&rate, (uint32_t)elapsed_ms);
+    }
+    if (nb_expired != 0)
+    {
+        div64(&slack_avg, nb_expired);
+    }
+    last_wakeups = nb_wakeups;
+    last_dump = now;
+
+    console_printf(CONSOLE_SERIAL, "timers: %s, %u queued\n", mode_names[mode], queued);
+    console_printf(CONSOLE_SERIAL, "  wakeups %u, %u/s since the last dump\n", nb_wakeups, (uint32_t)rate);
+    console_printf(CONSOLE_SERIAL, "  expired %u, slack avg %u ns max %u ns\n", nb_expired, (uint32_t)slack_avg,
+                   slack_worst);
+}
\ No newline at end of file
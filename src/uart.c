@@ -0,0 +1,203 @@
+#include "uart.h"
+#include "ioport.h"
+#include "cpu.h"
+
+// registers, from COM1_PORT
+#define UART_DATA 0 // RBR/THR, divisor low byte with DLAB
+#define UART_IER 1  // interrupt enable, divisor high byte with DLAB
+#define UART_IIR 2  // interrupt identification when read
+#define UART_FCR 2  // FIFO control when written
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+
+#define IER_RDA 0x1  // received data available
+#define IER_THRE 0x2 // transmit holding register empty
+
+#define FCR_ENABLE 0x1
+#define FCR_CLEAR_RX 0x2
+#define FCR_CLEAR_TX 0x4
+#define FCR_TRIGGER_14 0xC0
+
+#define LCR_8N1 0x3
+#define LCR_DLAB 0x80
+
+#define MCR_DTR 0x1
+#define MCR_RTS 0x2
+#define MCR_OUT2 0x8 // routes the interrupts to the PIC
+#define MCR_LOOPBACK 0x10
+
+#define LSR_DATA_READY 0x1
+#define LSR_THRE 0x20
+
+#define IIR_NO_INTERRUPT 0x1
+
+#define UART_FIFO_SIZE 16
+#define UART_CLOCK 115200 // baud rate of a divisor of 1
+
+static uint8_t present = 0;
+static uint8_t irq_enabled = 0; // until the IRQ handler is set, writes poll the line status
+
+static char tx_ring[UART_TX_RING];
+static uint32_t tx_head = 0; // free running, masked on access
+static uint32_t tx_tail = 0;
+static uint8_t ier = 0;
+
+static char rx_ring[UART_RX_RING];
+static uint32_t rx_head = 0;
+static uint32_t rx_tail = 0;
+
+/**
+ * @brief Programs COM1 at UART_BAUD, 8N1, with its 16 bytes FIFOs. A loopback test tells if it is there.
+ */
+void init_uart(void)
+{
+    outb(COM1_PORT + UART_IER, 0);
+    outb(COM1_PORT + UART_LCR, LCR_DLAB);
+    outb(COM1_PORT + UART_DATA, (UART_CLOCK / UART_BAUD) & 0xFF);
+    outb(COM1_PORT + UART_IER, (UART_CLOCK / UART_BAUD) >> 8);
+    outb(COM1_PORT + UART_LCR, LCR_8N1);
+    outb(COM1_PORT + UART_FCR, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX | FCR_TRIGGER_14);
+
+    outb(COM1_PORT + UART_MCR, MCR_LOOPBACK | MCR_RTS | MCR_DTR);
+    outb(COM1_PORT + UART_DATA, 0xAE);
+    if (inb(COM1_PORT + UART_DATA) != 0xAE)
+    {
+        return;
+    }
+    outb(COM1_PORT + UART_MCR, MCR_OUT2 | MCR_RTS | MCR_DTR);
+    present = 1;
+}
+
+/**
+ * @brief Switches to the interrupt driven transmit, once the IRQ handler is set.
+ */
+void uart_enable_irq(void)
+{
+    if (!present)
+    {
+        return;
+    }
+    ier = IER_RDA;
+    outb(COM1_PORT + UART_IER, ier);
+    irq_enabled = 1;
+}
+
+static void set_ier(uint8_t value)
+{
+    if (ier != value)
+    {
+        ier = value;
+        outb(COM1_PORT + UART_IER, ier);
+    }
+}
+
+/**
+ * @brief Fills the transmit FIFO from the ring, the FIFO is empty whenever THRE is set.
+ */
+static void fill_fifo(void)
+{
+    for (uint32_t i = 0; i < UART_FIFO_SIZE && tx_tail != tx_head; i++)
+    {
+        outb(COM1_PORT + UART_DATA, tx_ring[tx_tail++ % UART_TX_RING]);
+    }
+}
+
+static void poll_fifo(void)
+{
+    while (!(inb(COM1_PORT + UART_LSR) & LSR_THRE))
+        ;
+    fill_fifo();
+}
+
+void uart_irq_handler(void)
+{
+    uint8_t iir;
+    while (!((iir = inb(COM1_PORT + UART_IIR)) & IIR_NO_INTERRUPT))
+    {
+        while (inb(COM1_PORT + UART_LSR) & LSR_DATA_READY)
+        {
+            char c = inb(COM1_PORT + UART_DATA);
+            if (rx_head - rx_tail < UART_RX_RING)
+            {
+                rx_ring[rx_head++ % UART_RX_RING] = c;
+            }
+        }
+        if (inb(COM1_PORT + UART_LSR) & LSR_THRE)
+        {
+            fill_fifo();
+            if (tx_tail == tx_head)
+            {
+                set_ier(IER_RDA);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Queues len bytes for the transmit interrupt. The line status is only polled before the interrupts
+ * are set up and when the ring is full.
+ */
+void uart_write(const char *buffer, size_t len)
+{
+    if (!present)
+    {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (tx_head - tx_tail == UART_TX_RING)
+        {
+            poll_fifo();
+        }
+        tx_ring[tx_head++ % UART_TX_RING] = buffer[i];
+    }
+
+    if (!irq_enabled)
+    {
+        while (tx_tail != tx_head)
+        {
+            poll_fifo();
+        }
+    }
+    else
+    {
+        // the UART raises THRE as soon as it is enabled if the FIFO is already empty
+        set_ier(IER_RDA | IER_THRE);
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief Sends what is left in the ring by polling, for the paths that stop the kernel with the interrupts disabled.
+ */
+void uart_sync(void)
+{
+    if (!present)
+    {
+        return;
+    }
+    uint32_t flags = irq_save();
+    while (tx_tail != tx_head)
+    {
+        poll_fifo();
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief Takes a received character, -1 when there is none.
+ */
+int uart_getc(void)
+{
+    uint32_t flags = irq_save();
+    int c = -1;
+    if (rx_tail != rx_head)
+    {
+        c = (uint8_t)rx_ring[rx_tail++ % UART_RX_RING];
+    }
+    irq_restore(flags);
+    return c;
+}
\ No newline at end of file
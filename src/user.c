@@ -1,10 +1,106 @@
-char user_stack[8192] __attribute__((aligned(4096)));
-char *user_stack_top = &user_stack[8192];
+#include <stdint.h>
+#include "syscall.h"
+#include "cpu.h"
+
+#define BENCH_SYSCALL_RUNS 10000
+
+typedef uint32_t (*syscall_t)(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+static uint32_t syscall_int(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    uint32_t res;
+    __asm__ volatile("int $0x80" /* SYSCALL_VECTOR */ : "=a"(res) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3) : "memory");
+    return res;
+}
+
+static uint32_t syscall_sysenter(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    uint32_t res;
+    __asm__ volatile(
+        " movl %%esp, %%esi \n"
+        " movl $1f, %%edi   \n"
+        " sysenter          \n"
+        " 1:                \n"
+        : "=a"(res), "+c"(arg2), "+d"(arg3)
+        : "a"(number), "b"(arg1)
+        : "esi", "edi", "memory");
+    return res;
+}
+
+static syscall_t syscall = syscall_int; // the kernel sets sysenter up whenever the CPU has it
+
+#ifdef BENCH
+static void write_number(uint32_t n)
+{
+    char digits[10];
+    uint32_t len = 0;
+    do
+    {
+        digits[sizeof(digits) - ++len] = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    syscall(SYS_WRITE, (uint32_t)&digits[sizeof(digits) - len], len, 0);
+}
+
+/**
+ * @brief Gets the average cycles of a round trip through a system call doing nothing.
+ */
+static uint32_t measure_syscall(syscall_t call)
+{
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_SYSCALL_RUNS; i++)
+    {
+        call(SYS_BRK, 0, 0, 0);
+    }
+    return (uint32_t)(rdtsc() - start) / BENCH_SYSCALL_RUNS;
+}
+
+static void bench_syscalls(void)
+{
+    static const char int_message[] = "user: null syscall, int 0x80 ";
+    static const char sysenter_message[] = " cycles, sysenter ";
+    static const char end_message[] = " cycles\n";
+
+    syscall(SYS_WRITE, (uint32_t)int_message, sizeof(int_message) - 1, 0);
+    write_number(measure_syscall(syscall_int));
+    if (syscall == syscall_sysenter)
+    {
+        syscall(SYS_WRITE, (uint32_t)sysenter_message, sizeof(sysenter_message) - 1, 0);
+        write_number(measure_syscall(syscall_sysenter));
+    }
+    syscall(SYS_WRITE, (uint32_t)end_message, sizeof(end_message) - 1, 0);
+}
+#endif
 
 void user_main(void)
 {
-    unsigned int res = 0;
-    __asm__ volatile("int $0x80; mov %%eax, %0" : "=r"(res));
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(CPUID_FEATURES, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_EDX_SEP)
+    {
+        syscall = syscall_sysenter;
+    }
+
+    static const char message[] = "user: heap pages come with the first access\n";
+    syscall(SYS_WRITE, (uint32_t)message, sizeof(message) - 1, 0);
+
+    // 64 KiB of heap, only the pages written get a frame
+    uint8_t *heap = (uint8_t *)syscall(SYS_BRK, 0, 0, 0);
+    syscall(SYS_BRK, (uint32_t)heap + 0x10000, 0, 0);
+    heap[0] = 1;
+    heap[0x8000] = 2;
+
+#ifdef BENCH
+    bench_syscalls();
+#endif
+
+    // the kernel idles while no line is typed
+    static const char prompt[] = "user: ";
+    char line[64];
     for (;;)
-        ;
+    {
+        uint32_t len = syscall(SYS_READ, 0, (uint32_t)line, sizeof(line));
+        syscall(SYS_WRITE, (uint32_t)prompt, sizeof(prompt) - 1, 0);
+        syscall(SYS_WRITE, (uint32_t)line, len, 0);
+    }
 }
\ No newline at end of file
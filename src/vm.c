@@ -0,0 +1,405 @@
+#include "vm.h"
+#include "mmu.h"
+#include "buddy.h"
+#include "slab.h"
+#include "cpu.h"
+#include "swap.h"
+#include "reclaim.h"
+#include "klog.h"
+
+mm_t *current_mm = NULL;
+
+static kmem_cache_t *mm_cache;
+static kmem_cache_t *vma_cache;
+
+void init_vm(void)
+{
+    mm_cache = kmem_cache_create("mm", sizeof(mm_t), 0);
+    vma_cache = kmem_cache_create("vma", sizeof(vma_t), 0);
+}
+
+/**
+ * @brief Creates an address space with the kernel mappings and no user area.
+ */
+mm_t *mm_create(void)
+{
+    mm_t *mm = kmem_cache_alloc(mm_cache);
+    if (mm == NULL)
+    {
+        return NULL;
+    }
+
+    memset(mm, 0, sizeof(mm_t));
+    mm->directory = create_address_space();
+    if (mm->directory == 0)
+    {
+        kmem_cache_free(mm_cache, mm);
+        return NULL;
+    }
+    return mm;
+}
+
+/**
+ * @brief Unmaps [start, end), putting the anonymous pages.
+ */
+static void mm_unmap(mm_t *mm, uint32_t start, uint32_t end)
+{
+    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE)
+    {
+        // a shared page table is seen by other address spaces, it cannot be edited
+        if ((addr == start || addr % LARGE_PAGE_SIZE == 0) && unshare_user_page_table(mm->directory, addr) != 0)
+        {
+            printf("vm: no memory to unmap %x\n", addr);
+            return;
+        }
+
+        uint32_t flags;
+        uint32_t phys_addr = unmap_user_page(mm->directory, addr, &flags);
+        if (phys_addr != 0 && (flags & MAP_ANON))
+        {
+            put_page(phys_addr);
+        }
+    }
+}
+
+void mm_destroy(mm_t *mm)
+{
+    if (current_mm == mm)
+    {
+        mm_switch(NULL);
+    }
+
+    while (mm->vmas != NULL)
+    {
+        vma_t *vma = mm->vmas;
+        mm->vmas = vma->next;
+        kmem_cache_free(vma_cache, vma);
+    }
+    put_user_page_tables(mm->directory);
+    destroy_address_space(mm->directory);
+    kmem_cache_free(mm_cache, mm);
+}
+
+/**
+ * @brief Adds an area to an address space. Nothing is mapped until the first access.
+ *
+ * @param start Page aligned start, the area may be empty for a heap.
+ * @param end Page aligned end.
+ * @param phys Physical memory mapped by the area, 0 for zero filled memory.
+ * @return The area, NULL if it is outside the user space or overlaps another one.
+ */
+vma_t *mm_add_vma(mm_t *mm, uint32_t start, uint32_t end, uint32_t flags, uint32_t phys)
+{
+    if (start < USER_SPACE_START || end > KERNEL_VIRT_BASE || start > end ||
+        (start | end | phys) & (PAGE_SIZE - 1))
+    {
+        return NULL;
+    }
+
+    vma_t **link = &mm->vmas;
+    while (*link != NULL && (*link)->end <= start)
+    {
+        link = &(*link)->next;
+    }
+    if (*link != NULL && (*link)->start < end)
+    {
+        return NULL;
+    }
+
+    vma_t *vma = kmem_cache_alloc(vma_cache);
+    if (vma == NULL)
+    {
+        return NULL;
+    }
+    vma->start = start;
+    vma->end = end;
+    vma->flags = flags;
+    vma->phys = phys;
+    vma->next = *link;
+    *link = vma;
+    return vma;
+}
+
+vma_t *mm_find_vma(mm_t *mm, uint32_t addr)
+{
+    for (vma_t *vma = mm->vmas; vma != NULL && vma->start <= addr; vma = vma->next)
+    {
+        if (addr < vma->end)
+        {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Moves the end of the heap area. Growing only moves the limit, the pages come with the faults.
+ * @return The new break, or the current one if it cannot move there.
+ */
+uint32_t mm_brk(mm_t *mm, uint32_t brk)
+{
+    vma_t *heap = mm->heap;
+    if (heap == NULL || brk < heap->start)
+    {
+        return mm->brk;
+    }
+
+    uint32_t end = PAGE_ALIGN_UP(brk);
+    if (end < brk || (heap->next != NULL && end > heap->next->start) || end > KERNEL_VIRT_BASE)
+    {
+        return mm->brk;
+    }
+    if (end < heap->end)
+    {
+        mm_unmap(mm, end, heap->end);
+    }
+    heap->end = end;
+    mm->brk = brk;
+    return brk;
+}
+
+/**
+ * @brief Loads an address space, NULL going back to the kernel page directory.
+ */
+void mm_switch(mm_t *mm)
+{
+    current_mm = mm;
+    switch_address_space(mm != NULL ? mm->directory : kernel_directory);
+}
+
+/**
+ * @brief Extends a stack area down to a faulting address, if the stack stays under USER_STACK_MAX
+ * and does not run into the area below it.
+ */
+static vma_t *grow_stack(mm_t *mm, uint32_t addr)
+{
+    vma_t *stack = mm->stack;
+    if (stack == NULL || !(stack->flags & VMA_GROWSDOWN) || addr >= stack->start || stack->end - PAGE_ALIGN_DOWN(addr) > USER_STACK_MAX)
+    {
+        return NULL;
+    }
+
+    for (vma_t *vma = mm->vmas; vma != stack; vma = vma->next)
+    {
+        if (vma->end > PAGE_ALIGN_DOWN(addr))
+        {
+            return NULL;
+        }
+    }
+    stack->start = PAGE_ALIGN_DOWN(addr);
+    return stack;
+}
+
+/**
+ * @brief Creates a copy of an address space sharing all its pages. Only the page directory and the
+ * areas are copied, the page tables are shared until the first write of either side.
+ * @return The copy, NULL if there is not enough memory.
+ */
+mm_t *mm_clone(mm_t *mm)
+{
+    mm_t *child = mm_create();
+    if (child == NULL)
+    {
+        return NULL;
+    }
+
+    for (vma_t *vma = mm->vmas; vma != NULL; vma = vma->next)
+    {
+        vma_t *copy = mm_add_vma(child, vma->start, vma->end, vma->flags, vma->phys);
+        if (copy == NULL)
+        {
+            mm_destroy(child);
+            return NULL;
+        }
+        if (vma == mm->heap)
+        {
+            child->heap = copy;
+        }
+        if (vma == mm->stack)
+        {
+            child->stack = copy;
+        }
+    }
+    child->brk = mm->brk;
+
+    share_user_page_tables(mm->directory, child->directory);
+    return child;
+}
+
+/**
+ * @brief Allocates a page for a user mapping, reclaiming cold user pages when memory runs out.
+ */
+static uint32_t alloc_user_page(uint8_t zeroed)
+{
+    uint32_t page = zeroed ? alloc_zeroed_highmem_page() : alloc_highmem_page();
+    if (page == 0 && reclaim_pages(RECLAIM_BATCH) > 0)
+    {
+        page = zeroed ? alloc_zeroed_highmem_page() : alloc_highmem_page();
+    }
+    return page;
+}
+
+/**
+ * @brief Handles a write to a present read only page of a writable area. The page is copied,
+ * unless this address space holds its only reference, in which case it just becomes writable again.
+ */
+static int copy_on_write(mm_t *mm, uint32_t page)
+{
+    uint32_t flags;
+    uint32_t phys_addr = get_user_page(mm->directory, page, &flags);
+    if (phys_addr == 0 || (flags & MAP_WRITE))
+    {
+        return 0; // reclaimed or already made writable, the access faults again if needed
+    }
+    if ((flags & MAP_ANON) && addr_to_frame(phys_addr)->refcount == 1)
+    {
+        return map_user_page(mm->directory, page, phys_addr, MAP_WRITE | MAP_ANON);
+    }
+
+    uint32_t copy = alloc_user_page(0);
+    if (copy == 0)
+    {
+        return -1;
+    }
+    // the allocation may have reclaimed the page
+    if (get_user_page(mm->directory, page, &flags) != phys_addr)
+    {
+        free_page(copy);
+        return 0;
+    }
+
+    void *src = kmap(phys_addr);
+    void *dest = kmap(copy);
+    if (src != NULL && dest != NULL)
+    {
+        memcpy(dest, src, PAGE_SIZE);
+    }
+    kunmap(dest);
+    kunmap(src);
+    if (src == NULL || dest == NULL || map_user_page(mm->directory, page, copy, MAP_WRITE | MAP_ANON) != 0)
+    {
+        free_page(copy);
+        return -1;
+    }
+    if (flags & MAP_ANON)
+    {
+        put_page(phys_addr);
+    }
+    return 0;
+}
+
+/**
+ * @brief Maps the page of an area holding a not present address: the page back from swap,
+ * the backing physical memory, or a new zeroed page.
+ */
+static int fill_page(mm_t *mm, vma_t *vma, uint32_t page)
+{
+    uint32_t flags = vma->flags & VMA_WRITE ? MAP_WRITE : 0;
+    uint32_t slot = get_user_swap_slot(mm->directory, page);
+    if (slot != SWAP_NONE)
+    {
+        uint32_t phys_addr = alloc_user_page(0);
+        if (phys_addr == 0)
+        {
+            return -1;
+        }
+        // the page is private again once read, clones sharing the slot read their own copy
+        if (swap_read(slot, phys_addr) != 0 || map_user_page(mm->directory, page, phys_addr, flags | MAP_ANON) != 0)
+        {
+            free_page(phys_addr);
+            return -1;
+        }
+        swap_free(slot);
+        return 0;
+    }
+
+    if (vma->phys != 0)
+    {
+        // shared with the image until written, if the area is writable
+        return map_user_page(mm->directory, page, vma->phys + (page - vma->start), 0);
+    }
+
+    uint32_t phys_addr = alloc_user_page(1);
+    if (phys_addr == 0)
+    {
+        return -1;
+    }
+    if (map_user_page(mm->directory, page, phys_addr, flags | MAP_ANON) != 0)
+    {
+        free_page(phys_addr);
+        return -1;
+    }
+    addr_to_frame(phys_addr)->flags |= FRAME_ZERO;
+    return 0;
+}
+
+/**
+ * @brief Resolves a page fault of the current address space: maps the missing pages of the areas,
+ * grows the stack and copies the shared pages on write.
+ * @return 0 if the access can be retried, -1 if it is invalid or there is no memory left.
+ */
+int mm_handle_fault(mm_t *mm, uint32_t addr, uint32_t error)
+{
+    if (mm == NULL)
+    {
+        return -1;
+    }
+
+    vma_t *vma = mm_find_vma(mm, addr);
+    if (vma == NULL && !(error & PF_PRESENT))
+    {
+        vma = grow_stack(mm, addr);
+    }
+    if (vma == NULL || ((error & PF_WRITE) && !(vma->flags & VMA_WRITE)))
+    {
+        return -1;
+    }
+
+    uint32_t page = PAGE_ALIGN_DOWN(addr);
+    if (unshare_user_page_table(mm->directory, page) != 0)
+    {
+        klog(KLOG_ERR, "vm: out of memory at %x\n", addr);
+        return -1;
+    }
+
+    int res;
+    if (!(error & PF_PRESENT))
+    {
+        res = fill_page(mm, vma, page);
+    }
+    else if (error & PF_WRITE)
+    {
+        res = copy_on_write(mm, page);
+    }
+    else
+    {
+        return -1;
+    }
+    if (res != 0)
+    {
+        klog(KLOG_ERR, "vm: out of memory at %x\n", addr);
+    }
+    return res;
+}
+
+/**
+ * @brief Prints the areas of an address space with the memory they really use.
+ */
+void mm_stats(mm_t *mm)
+{
+    uint32_t virtual_pages = 0, resident_pages = 0, swapped_pages = 0;
+    for (vma_t *vma = mm->vmas; vma != NULL; vma = vma->next)
+    {
+        printf("%x-%x %s%s%s\n", vma->start, vma->end, vma->flags & VMA_READ ? "r" : "-",
+               vma->flags & VMA_WRITE ? "w" : "-", vma->phys != 0 ? " fixed" : "");
+        for (uint32_t addr = vma->start; addr < vma->end; addr += PAGE_SIZE)
+        {
+            uint32_t flags;
+            resident_pages += get_user_page(mm->directory, addr, &flags) != 0;
+            swapped_pages += get_user_swap_slot(mm->directory, addr) != SWAP_NONE;
+        }
+        virtual_pages += (vma->end - vma->start) / PAGE_SIZE;
+    }
+    printf("vm: %d KiB resident, %d KiB swapped, %d KiB reserved\n", resident_pages * (PAGE_SIZE / 1024),
+           swapped_pages * (PAGE_SIZE / 1024), virtual_pages * (PAGE_SIZE / 1024));
+}
\ No newline at end of file